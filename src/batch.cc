@@ -0,0 +1,184 @@
+
+#include "batch.hh"
+#include "context.hh"
+#include "io.hh"
+#include "jobs.hh"
+#include "workers.hh"
+#include "dispatcher.hh"
+#include "options.hh"
+#include "thread_pool.hh"
+#include "log.hh"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/stat.h>
+
+namespace BATCH
+{
+
+namespace
+{
+
+typedef std::chrono::steady_clock CLOCK_TYPE;
+
+struct INSTANCE
+{
+	std::string input_path;
+	std::string output_path;
+	bool solved = false;
+	std::string error; // If not solved
+	size_t num_jobs = 0;
+	size_t num_workers = 0;
+	JOBS::COST_CALC::COST cost = 0;
+	float seconds = 0;
+};
+
+// One path per line. Empty lines are skipped.
+std::vector<std::string> l_read_input_paths(const std::string & list_path)
+{
+	std::ifstream list_file;
+	if (list_path != "-")
+	{
+		list_file.open(list_path);
+		if (!list_file)
+		{
+			std::cerr << "Error: Can't open " << list_path << ": " << std::strerror(errno) << std::endl;
+			exit(1);
+		}
+	}
+	std::istream & list = (list_path == "-") ? std::cin : list_file;
+	std::vector<std::string> input_paths;
+	std::string line;
+	while (std::getline(list, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (!line.empty())
+		{
+			input_paths.push_back(line);
+		}
+	}
+	return input_paths;
+}
+
+// <dir>/<input name without its extension>.schedule.<format>, where dir is --output-dir or the
+// input's own directory.
+std::string l_get_output_path(const std::string & input_path)
+{
+	const OPTIONS::OPTION_MGR & options = OPTIONS::OPTION_MGR::get_inst();
+	size_t name_begin = input_path.rfind('/');
+	name_begin = (name_begin == std::string::npos) ? 0 : name_begin + 1;
+	std::string dir = options.get_output_dir().empty() ? input_path.substr(0, name_begin) : options.get_output_dir() + "/";
+	std::string name = input_path.substr(name_begin);
+	size_t extension_begin = name.rfind('.');
+	if (extension_begin != std::string::npos && extension_begin > 0)
+	{
+		name.resize(extension_begin);
+	}
+	const char * extension = "txt";
+	switch (options.get_output_format())
+	{
+	case OPTIONS::OUTPUT_FORMAT::TEXT: extension = "txt"; break;
+	case OPTIONS::OUTPUT_FORMAT::CSV: extension = "csv"; break;
+	case OPTIONS::OUTPUT_FORMAT::BINARY: extension = "bin"; break;
+	}
+	return dir + name + ".schedule." + extension;
+}
+
+// On any thread. Everything it touches belongs to the instance's own context.
+void l_solve_instance(INSTANCE & instance)
+{
+	CLOCK_TYPE::time_point start_time = CLOCK_TYPE::now();
+	CONTEXT::SCHED_CONTEXT context(1, instance.output_path);
+	CONTEXT::SCOPE context_scope(context);
+
+	// Before loading, so that no work is done for an instance whose schedule can't be written
+	if (!context.open_schedule_writer(instance.error) || !IO::load_from_file(instance.input_path, instance.error))
+	{
+		return;
+	}
+	JOBS::JOB_QUEUE::load();
+	DISPATCHER::dispatch_all();
+	instance.cost = JOBS::COST_CALC::get_total_cost();
+	instance.num_jobs = JOBS::JOB_POOL::get_inst().size();
+	instance.num_workers = WORKERS::WORKER_MGR::get_inst().size();
+	instance.solved = true;
+	instance.seconds = std::chrono::duration_cast<std::chrono::duration<float>>(CLOCK_TYPE::now() - start_time).count();
+}
+
+} // End anonymous namespace
+
+bool solve()
+{
+	const OPTIONS::OPTION_MGR & options = OPTIONS::OPTION_MGR::get_inst();
+	CLOCK_TYPE::time_point start_time = CLOCK_TYPE::now();
+
+	std::vector<std::string> input_paths = l_read_input_paths(options.get_batch_list_path());
+	if (input_paths.empty())
+	{
+		std::cerr << "No inputs to solve. Quitting...";
+		exit(1);
+	}
+	struct stat dir_stat;
+	if (!options.get_output_dir().empty() && (stat(options.get_output_dir().c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)))
+	{
+		std::cerr << "Error: " << options.get_output_dir() << " isn't a directory\n";
+		exit(1);
+	}
+
+	std::vector<INSTANCE> instances(input_paths.size());
+	for (size_t i = 0; i < input_paths.size(); ++i)
+	{
+		instances[i].input_path = input_paths[i];
+		instances[i].output_path = l_get_output_path(input_paths[i]);
+	}
+
+	size_t num_threads = std::min(options.get_num_threads(), instances.size());
+	SCHED_LOG(INFO) << "Solving " << instances.size() << " inputs on " << num_threads << " thread(s)...";
+
+	// Lines from instances solved at once would interleave, and couldn't be told apart anyway.
+	LOG::LEVEL log_level = LOG::LOGGER::get_level();
+	LOG::LOGGER::set_level(std::min(log_level, LOG::LEVEL::WARNING));
+	{
+		THREADS::THREAD_POOL thread_pool(num_threads);
+		thread_pool.parallel_for(instances.size(),
+			[&instances](size_t i)
+			{
+				l_solve_instance(instances[i]);
+			});
+	}
+	LOG::LOGGER::set_level(log_level);
+
+	size_t num_solved = 0;
+	for (INSTANCE & instance: instances)
+	{
+		if (instance.solved)
+		{
+			SCHED_LOG(INFO) << instance.input_path << ": " << instance.num_jobs << " jobs, " << instance.num_workers
+				<< " workers, cost " << instance.cost << " in " << instance.seconds << "s -> " << instance.output_path;
+			++num_solved;
+		}
+		else
+		{
+			while (!instance.error.empty() && instance.error.back() == '\n')
+			{
+				instance.error.pop_back();
+			}
+			SCHED_LOG(ERROR) << instance.input_path << ": " << instance.error;
+		}
+	}
+	float seconds = std::chrono::duration_cast<std::chrono::duration<float>>(CLOCK_TYPE::now() - start_time).count();
+	SCHED_LOG(INFO) << "Solved " << num_solved << " of " << instances.size() << " inputs in " << seconds << "s";
+	return num_solved == instances.size();
+}
+
+} // End namespace BATCH
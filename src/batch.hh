@@ -0,0 +1,14 @@
+#ifndef BATCH_HH
+#define BATCH_HH
+
+namespace BATCH
+{
+
+// Solves every input file listed in the --batch file, --threads of them at once, each in a
+// CONTEXT::SCHED_CONTEXT of its own. Each schedule goes to a file of its own, and the cost of every
+// input is logged once all are done. Returns false if any of them couldn't be solved.
+bool solve();
+
+} // End namespace BATCH
+
+#endif
@@ -0,0 +1,600 @@
+// Microbenchmarks of the scheduler's hot kernels: the slot search in one worker's history, job
+// projection over all workers, the dispatcher's pick, evaluating the total cost and loading the
+// input.
+//
+// Every repetition of a case runs in a forked child, so that it starts from a fresh process-wide
+// scheduler context, with an empty job pool and no workers. The best repetition is reported. Inputs
+// come from a fixed seed, so two runs with the same seed do the same work. Allocations are the calls
+// to operator new made while timing.
+//
+// Usage: kernels [--seed N] [--reps N] [--filter TEXT] [--json FILE]
+
+#include "jobs.hh"
+#include "workers.hh"
+#include "dispatcher.hh"
+#include "cost_engine.hh"
+#include "thread_pool.hh"
+#include "io.hh"
+#include "log.hh"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace
+{
+
+std::atomic<size_t> l_num_allocations{0};
+
+} // End anonymous namespace
+
+void * operator new(size_t size)
+{
+	++l_num_allocations;
+	void * ptr = std::malloc(size == 0 ? 1 : size);
+	if (ptr == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void * ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+namespace
+{
+
+typedef std::chrono::steady_clock CLOCK_TYPE;
+
+const uint32_t DEFAULT_SEED = 1;
+const size_t DEFAULT_NUM_REPS = 3;
+const double MIN_MEASURE_NS = 50e6; // Per repetition, for the kernels cheap enough to loop over
+
+// Handed from the child to the parent through a pipe
+struct RESULT
+{
+	size_t num_ops;
+	double ns;
+	size_t num_allocations;
+	uint64_t checksum; // Keeps the work from being optimized out
+};
+
+struct CASE
+{
+	std::string kernel;
+	std::vector<std::pair<std::string, size_t>> params;
+	std::function<RESULT(uint32_t)> run; // Takes the seed
+};
+
+// Adds up time and allocations between start() and stop(), so setup in between isn't counted
+class STOPWATCH
+{
+public:
+	void start()
+	{
+		m_start_num_allocations = l_num_allocations;
+		m_start = CLOCK_TYPE::now();
+	}
+
+	void stop(size_t num_ops)
+	{
+		CLOCK_TYPE::time_point end = CLOCK_TYPE::now();
+		m_result.ns += std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(end - m_start).count();
+		m_result.num_allocations += l_num_allocations - m_start_num_allocations;
+		m_result.num_ops += num_ops;
+	}
+
+	double get_ns() const { return m_result.ns; }
+
+	RESULT get_result(uint64_t checksum) const
+	{
+		RESULT result = m_result;
+		result.checksum = checksum;
+		return result;
+	}
+
+private:
+	CLOCK_TYPE::time_point m_start;
+	size_t m_start_num_allocations = 0;
+	RESULT m_result = RESULT();
+};
+
+// xorshift32
+uint32_t l_next_random(uint32_t & state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+uint32_t l_seed_random(uint32_t seed)
+{
+	uint32_t state = seed * 2654435761u ^ 0x9e3779b9u;
+	return state == 0 ? 1 : state;
+}
+
+void l_add_job(const char * prefix, size_t i, JOBS::PRIORITY priority, size_t num_subtasks,
+	JOBS::TIME earliest_start_time, JOBS::TIME subtask_duration)
+{
+	std::string name = prefix + std::to_string(i);
+	JOBS::JOB_POOL::get_inst().add_job(name.data(), name.size(), priority, num_subtasks, earliest_start_time,
+		subtask_duration);
+}
+
+void l_add_workers(size_t num_workers)
+{
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	for (size_t i = 0; i < num_workers; ++i)
+	{
+		worker_mgr.add_worker(WORKERS::WORKER("worker_" + std::to_string(i), i, worker_mgr.get_history_node_pool()));
+	}
+}
+
+// Jobs whose name starts with the prefix, in index order. Indices only settle once the pool is sorted.
+std::vector<JOBS::JOB_IDX> l_find_jobs(const char * prefix)
+{
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	std::vector<JOBS::JOB_IDX> job_idxs;
+	for (JOBS::JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+	{
+		if (job_pool[job_idx].get_name().compare(0, std::strlen(prefix), prefix) == 0)
+		{
+			job_idxs.push_back(job_idx);
+		}
+	}
+	return job_idxs;
+}
+
+// One worker with num_runs single subtask jobs in its history. Before each, there's a hole with the
+// given odds. Probes are single subtask jobs that may start anywhere in the history.
+RESULT l_bench_slot_search(uint32_t seed, size_t num_runs, size_t hole_pct)
+{
+	const size_t NUM_PROBES = 1024;
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	uint32_t random_state = l_seed_random(seed);
+
+	JOBS::TIME tail = 0;
+	for (size_t i = 0; i < num_runs; ++i)
+	{
+		if (l_next_random(random_state) % 100 < hole_pct)
+		{
+			tail += 1 + l_next_random(random_state) % 20;
+		}
+		JOBS::TIME duration = 1 + l_next_random(random_state) % 20;
+		l_add_job("hist_", i, 1, 1, tail, duration);
+		tail += duration;
+	}
+	for (size_t i = 0; i < NUM_PROBES; ++i)
+	{
+		l_add_job("probe_", i, 1, 1, l_next_random(random_state) % (tail + 1), 1 + l_next_random(random_state) % 20);
+	}
+	job_pool.sort_and_create_index();
+
+	// Each history job goes right at the tail, so submitting them by start time lays out the history
+	// as generated.
+	std::vector<JOBS::JOB_IDX> hist_jobs = l_find_jobs("hist_");
+	std::vector<JOBS::JOB_IDX> probes = l_find_jobs("probe_");
+	std::sort(hist_jobs.begin(), hist_jobs.end(),
+		[&job_pool](JOBS::JOB_IDX lhs, JOBS::JOB_IDX rhs)
+		{
+			return job_pool[lhs].get_earliest_start_time() < job_pool[rhs].get_earliest_start_time();
+		});
+
+	WORKERS::NODE_POOL node_pool;
+	WORKERS::WORKER worker("worker_0", 0, node_pool);
+	for (JOBS::JOB_IDX job_idx: hist_jobs)
+	{
+		worker.submit_subtask(job_pool[job_idx]);
+	}
+
+	STOPWATCH stopwatch;
+	uint64_t checksum = 0;
+	while (stopwatch.get_ns() < MIN_MEASURE_NS)
+	{
+		stopwatch.start();
+		for (JOBS::JOB_IDX job_idx: probes)
+		{
+			checksum += worker.get_earliest_subtask_start_time(job_pool[job_idx], 0);
+		}
+		stopwatch.stop(probes.size());
+	}
+	return stopwatch.get_result(checksum);
+}
+
+// Workers loaded with eight jobs each, then probes with the given number of subtasks. A cached
+// projection is only timed once the cache holds it.
+RESULT l_bench_projection(uint32_t seed, size_t num_workers, size_t num_subtasks, bool cached)
+{
+	const size_t NUM_PROBES = 256;
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	uint32_t random_state = l_seed_random(seed);
+
+	l_add_workers(num_workers);
+	for (size_t i = 0; i < 8 * num_workers; ++i)
+	{
+		l_add_job("load_", i, 1 + l_next_random(random_state) % 20, 1 + l_next_random(random_state) % 16,
+			l_next_random(random_state) % 1000, 1 + l_next_random(random_state) % 20);
+	}
+	for (size_t i = 0; i < NUM_PROBES; ++i)
+	{
+		l_add_job("probe_", i, 1 + l_next_random(random_state) % 20, num_subtasks,
+			l_next_random(random_state) % 1000, 1 + l_next_random(random_state) % 20);
+	}
+	job_pool.sort_and_create_index();
+	for (JOBS::JOB_IDX job_idx: l_find_jobs("load_"))
+	{
+		JOBS::JOB_ENTRY job = job_pool[job_idx];
+		worker_mgr.submit_job(job, job.get_modifiable_status());
+	}
+	std::vector<JOBS::JOB_IDX> probes = l_find_jobs("probe_");
+
+	uint64_t checksum = 0;
+	if (cached)
+	{
+		worker_mgr.resize_projection_cache(job_pool.size());
+		for (JOBS::JOB_IDX job_idx: probes)
+		{
+			checksum += worker_mgr.get_cached_projected_job_status(job_pool[job_idx]).get_complete_time();
+		}
+	}
+
+	STOPWATCH stopwatch;
+	while (stopwatch.get_ns() < MIN_MEASURE_NS)
+	{
+		stopwatch.start();
+		for (JOBS::JOB_IDX job_idx: probes)
+		{
+			checksum += cached ?
+				worker_mgr.get_cached_projected_job_status(job_pool[job_idx]).get_complete_time() :
+				worker_mgr.get_projected_job_status(job_pool[job_idx]).get_complete_time();
+		}
+		stopwatch.stop(probes.size());
+	}
+	return stopwatch.get_result(checksum);
+}
+
+// Dispatches the whole queue on one thread, timing only the picks
+RESULT l_bench_pick(uint32_t seed, size_t num_workers, size_t num_jobs)
+{
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	uint32_t random_state = l_seed_random(seed);
+
+	l_add_workers(num_workers);
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		l_add_job("job_", i, 1 + l_next_random(random_state) % 19, 1 + l_next_random(random_state) % 200,
+			l_next_random(random_state) % 800, 1 + l_next_random(random_state) % 50);
+	}
+	job_pool.sort_and_create_index();
+	JOBS::JOB_QUEUE::load();
+	JOBS::JOB_QUEUE & job_q = JOBS::JOB_QUEUE::get_inst();
+	worker_mgr.resize_projection_cache(job_pool.size());
+	THREADS::THREAD_POOL thread_pool(1);
+
+	STOPWATCH stopwatch;
+	uint64_t checksum = 0;
+	while (!job_q.empty())
+	{
+		stopwatch.start();
+		JOBS::JOB_QUEUE::ITER best_job = DISPATCHER::pick_best_job_to_execute(thread_pool);
+		stopwatch.stop(1);
+
+		JOBS::JOB_ENTRY job = job_pool[*best_job];
+		worker_mgr.submit_job(job, job.get_modifiable_status());
+		checksum += job.get_status().get_complete_time();
+		job_q.erase(best_job);
+	}
+	return stopwatch.get_result(checksum);
+}
+
+// A full evaluation of the total cost once every job is placed. An op is one job.
+RESULT l_bench_cost_evaluate(uint32_t seed, size_t num_jobs)
+{
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	uint32_t random_state = l_seed_random(seed);
+
+	l_add_workers(16);
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		l_add_job("job_", i, 1 + l_next_random(random_state) % 19, 1 + l_next_random(random_state) % 8,
+			l_next_random(random_state) % 100000, 1 + l_next_random(random_state) % 50);
+	}
+	job_pool.sort_and_create_index();
+	for (JOBS::JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+	{
+		JOBS::JOB_ENTRY job = job_pool[job_idx];
+		worker_mgr.submit_job(job, job.get_modifiable_status());
+	}
+	const JOBS::COST_CALC::COST_ENGINE & cost_engine = JOBS::COST_CALC::COST_ENGINE::get_inst();
+
+	STOPWATCH stopwatch;
+	double sum_cost = 0;
+	while (stopwatch.get_ns() < MIN_MEASURE_NS)
+	{
+		stopwatch.start();
+		sum_cost += cost_engine.evaluate();
+		stopwatch.stop(num_jobs);
+	}
+	return stopwatch.get_result(uint64_t(sum_cost));
+}
+
+// One load of a generated input, through a temporary file on stdin. An op is one input line.
+RESULT l_bench_load(uint32_t seed, size_t num_workers, size_t num_jobs)
+{
+	uint32_t random_state = l_seed_random(seed);
+	std::ostringstream input;
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		input << "job job_" << i << " " << 1 + l_next_random(random_state) % 200 << " "
+			<< 1 + l_next_random(random_state) % 50 << " " << l_next_random(random_state) % 800 << " "
+			<< 1 + l_next_random(random_state) % 19 << "\n";
+	}
+	for (size_t i = 0; i < num_workers; ++i)
+	{
+		input << "worker worker_" << i << "\n";
+	}
+	const std::string input_text = input.str();
+
+	std::FILE * input_file = std::tmpfile();
+	if (input_file == nullptr ||
+		std::fwrite(input_text.data(), 1, input_text.size(), input_file) != input_text.size() ||
+		std::fflush(input_file) != 0 ||
+		lseek(fileno(input_file), 0, SEEK_SET) != 0 ||
+		dup2(fileno(input_file), STDIN_FILENO) < 0)
+	{
+		std::cerr << "Error: Can't set up the input file\n";
+		_exit(1);
+	}
+
+	STOPWATCH stopwatch;
+	stopwatch.start();
+	IO::load_from_stdin();
+	stopwatch.stop(num_jobs + num_workers);
+	return stopwatch.get_result(JOBS::JOB_POOL::get_inst().size());
+}
+
+std::vector<CASE> l_make_cases()
+{
+	std::vector<CASE> cases;
+	for (size_t num_runs: {16, 256, 4096})
+	{
+		for (size_t hole_pct: {0, 10, 50})
+		{
+			cases.push_back({"slot_search", {{"history", num_runs}, {"hole_pct", hole_pct}},
+				[num_runs, hole_pct](uint32_t seed) { return l_bench_slot_search(seed, num_runs, hole_pct); }});
+		}
+	}
+	for (bool cached: {false, true})
+	{
+		for (size_t num_workers: {4, 32, 128, 1024})
+		{
+			for (size_t num_subtasks: {1, 16, 256})
+			{
+				cases.push_back({cached ? "cached_projected_job_status" : "projected_job_status",
+					{{"workers", num_workers}, {"subtasks", num_subtasks}},
+					[num_workers, num_subtasks, cached](uint32_t seed)
+					{
+						return l_bench_projection(seed, num_workers, num_subtasks, cached);
+					}});
+			}
+		}
+	}
+	for (size_t num_workers: {8, 64})
+	{
+		for (size_t num_jobs: {500, 2000})
+		{
+			cases.push_back({"pick_best_job_to_execute", {{"workers", num_workers}, {"jobs", num_jobs}},
+				[num_workers, num_jobs](uint32_t seed) { return l_bench_pick(seed, num_workers, num_jobs); }});
+		}
+	}
+	for (size_t num_jobs: {1000, 100000})
+	{
+		cases.push_back({"cost_evaluate", {{"jobs", num_jobs}},
+			[num_jobs](uint32_t seed) { return l_bench_cost_evaluate(seed, num_jobs); }});
+	}
+	for (size_t num_jobs: {10000, 200000})
+	{
+		cases.push_back({"load_from_stdin", {{"workers", 16}, {"jobs", num_jobs}},
+			[num_jobs](uint32_t seed) { return l_bench_load(seed, 16, num_jobs); }});
+	}
+	return cases;
+}
+
+// Runs the case in a child process. Returns false if the child didn't report back.
+bool l_run_isolated(const CASE & bench_case, uint32_t seed, RESULT & result)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		return false;
+	}
+	std::cout.flush();
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0)
+	{
+		close(fds[0]);
+		RESULT child_result = bench_case.run(seed);
+		bool written = write(fds[1], &child_result, sizeof(child_result)) == sizeof(child_result);
+		_exit(written ? 0 : 1);
+	}
+
+	close(fds[1]);
+	ssize_t num_read = read(fds[0], &result, sizeof(result));
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return num_read == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0 && result.num_ops > 0;
+}
+
+std::string l_params_to_string(const CASE & bench_case)
+{
+	std::string retval;
+	for (const auto & param: bench_case.params)
+	{
+		retval += (retval.empty() ? "" : " ") + param.first + "=" + std::to_string(param.second);
+	}
+	return retval;
+}
+
+void l_write_json(std::ostream & os, uint32_t seed, size_t num_reps,
+	const std::vector<std::pair<const CASE *, RESULT>> & results)
+{
+	os << "{\n  \"seed\": " << seed << ",\n  \"reps\": " << num_reps << ",\n  \"results\": [";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const CASE & bench_case = *results[i].first;
+		const RESULT & result = results[i].second;
+		os << (i == 0 ? "\n" : ",\n") << "    {\"kernel\": \"" << bench_case.kernel << "\", \"params\": {";
+		for (size_t j = 0; j < bench_case.params.size(); ++j)
+		{
+			os << (j == 0 ? "" : ", ") << "\"" << bench_case.params[j].first << "\": " << bench_case.params[j].second;
+		}
+		os << "}, \"ops\": " << result.num_ops
+			<< ", \"ns_per_op\": " << result.ns / result.num_ops
+			<< ", \"ops_per_s\": " << result.num_ops / result.ns * 1e9
+			<< ", \"allocs_per_op\": " << double(result.num_allocations) / result.num_ops << "}";
+	}
+	os << "\n  ]\n}\n";
+}
+
+void l_print_usage(const char * exec_name)
+{
+	std::cerr << "Usage: " << exec_name << " [--seed N] [--reps N] [--filter TEXT] [--json FILE]\n"
+		<< "  --seed N       Seed of the generated inputs (default " << DEFAULT_SEED << ")\n"
+		<< "  --reps N       Repetitions of each case, the best is reported (default " << DEFAULT_NUM_REPS << ")\n"
+		<< "  --filter TEXT  Only run the kernels whose name contains TEXT\n"
+		<< "  --json FILE    Also write the results to FILE as JSON\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char ** argv)
+{
+	uint32_t seed = DEFAULT_SEED;
+	size_t num_reps = DEFAULT_NUM_REPS;
+	std::string filter;
+	std::string json_path;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option = argv[i];
+		if (i + 1 >= argc || (option != "--seed" && option != "--reps" && option != "--filter" && option != "--json"))
+		{
+			l_print_usage(argv[0]);
+			return 1;
+		}
+		std::string value = argv[++i];
+		if (option == "--seed")
+		{
+			seed = std::strtoul(value.c_str(), nullptr, 10);
+		}
+		else if (option == "--reps")
+		{
+			num_reps = std::strtoul(value.c_str(), nullptr, 10);
+		}
+		else if (option == "--filter")
+		{
+			filter = value;
+		}
+		else
+		{
+			json_path = value;
+		}
+	}
+	if (num_reps == 0)
+	{
+		l_print_usage(argv[0]);
+		return 1;
+	}
+
+	LOG::LOGGER::set_level(LOG::LEVEL::ERROR);
+	const std::vector<CASE> cases = l_make_cases();
+	std::vector<std::pair<const CASE *, RESULT>> results;
+
+	std::cout << std::left << std::setw(28) << "kernel" << std::setw(24) << "params"
+		<< std::right << std::setw(12) << "ns/op" << std::setw(14) << "ops/s" << std::setw(12) << "allocs/op" << "\n";
+	for (const CASE & bench_case: cases)
+	{
+		if (bench_case.kernel.find(filter) == std::string::npos)
+		{
+			continue;
+		}
+		RESULT best = RESULT();
+		for (size_t rep = 0; rep < num_reps; ++rep)
+		{
+			RESULT result;
+			if (!l_run_isolated(bench_case, seed, result))
+			{
+				std::cerr << "Error: " << bench_case.kernel << " " << l_params_to_string(bench_case) << " failed\n";
+				return 1;
+			}
+			if (rep == 0 || result.ns / result.num_ops < best.ns / best.num_ops)
+			{
+				best = result;
+			}
+		}
+		results.emplace_back(&bench_case, best);
+		std::cout << std::left << std::setw(28) << bench_case.kernel << std::setw(24) << l_params_to_string(bench_case)
+			<< std::right << std::fixed << std::setprecision(1) << std::setw(12) << best.ns / best.num_ops
+			<< std::setprecision(0) << std::setw(14) << best.num_ops / best.ns * 1e9
+			<< std::setprecision(2) << std::setw(12) << double(best.num_allocations) / best.num_ops << "\n";
+	}
+
+	if (!json_path.empty())
+	{
+		std::ofstream json_file(json_path);
+		l_write_json(json_file, seed, num_reps, results);
+		if (!json_file)
+		{
+			std::cerr << "Error: Can't write " << json_path << "\n";
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,149 @@
+// Scan throughput of JOB_QUEUE against the std::list of job indices it replaced.
+//
+// Two patterns: full passes over the queue, and the dispatcher's, which walks a window from the head
+// and erases one job in it until the queue is empty.
+//
+// Usage: queue_scan [num_jobs] [window]
+
+#include "jobs.hh"
+#include "workers.hh"
+#include "log.hh"
+
+#include <iostream>
+#include <string>
+#include <list>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+
+namespace
+{
+
+typedef std::chrono::steady_clock CLOCK_TYPE;
+typedef std::list<JOBS::JOB_IDX> LIST_QUEUE;
+
+const size_t NUM_WORKERS = 8;
+const size_t NUM_FULL_PASSES = 20;
+
+// xorshift32, fixed seed so that every run does the same work
+uint32_t l_next_random(uint32_t & state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+void l_fill_job_pool(size_t num_jobs)
+{
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	for (size_t i = 0; i < NUM_WORKERS; ++i)
+	{
+		worker_mgr.add_worker(WORKERS::WORKER("worker_" + std::to_string(i), i, worker_mgr.get_history_node_pool()));
+	}
+
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	uint32_t random_state = 2463534242u;
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		std::string name = "job_" + std::to_string(i);
+		job_pool.add_job(name.data(), name.size(),
+			1 + l_next_random(random_state) % 20, 1 + l_next_random(random_state) % 50,
+			l_next_random(random_state) % 1000, 1 + l_next_random(random_state) % 20);
+	}
+	job_pool.sort_and_create_index();
+}
+
+// Reads a field of every job it passes, like the dispatcher's pruning bound does
+template <typename QUEUE>
+size_t l_full_passes(QUEUE & queue, JOBS::JOB_POOL & job_pool, size_t & checksum)
+{
+	size_t num_scanned = 0;
+	for (size_t pass = 0; pass < NUM_FULL_PASSES; ++pass)
+	{
+		for (auto iter = queue.begin(); iter != queue.end(); ++iter)
+		{
+			checksum += job_pool[*iter].get_priority();
+			++num_scanned;
+		}
+	}
+	return num_scanned;
+}
+
+template <typename QUEUE>
+size_t l_dispatch_pattern(QUEUE & queue, JOBS::JOB_POOL & job_pool, size_t window, size_t & checksum)
+{
+	uint32_t random_state = 88675123u;
+	size_t num_scanned = 0;
+	while (!queue.empty())
+	{
+		size_t victim_pos = l_next_random(random_state) % window;
+		auto victim = queue.begin();
+		size_t pos = 0;
+		for (auto iter = queue.begin(); iter != queue.end() && pos < window; ++iter, ++pos)
+		{
+			checksum += job_pool[*iter].get_priority();
+			if (pos == victim_pos)
+			{
+				victim = iter;
+			}
+		}
+		num_scanned += pos;
+		queue.erase(victim);
+	}
+	return num_scanned;
+}
+
+void l_report(const char * queue_name, const char * pattern_name, size_t num_scanned, CLOCK_TYPE::duration duration)
+{
+	double ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(duration).count();
+	std::cout << queue_name << " " << pattern_name << ": " << num_scanned << " entries in " << ns / 1e6 << " ms, "
+		<< ns / num_scanned << " ns/entry (" << num_scanned / ns * 1e3 << " M entries/s)\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char ** argv)
+{
+	size_t num_jobs = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	size_t window = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 22;
+	if (num_jobs == 0 || window == 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [num_jobs] [window]\n";
+		return 1;
+	}
+
+	LOG::LOGGER::set_level(LOG::LEVEL::ERROR);
+	l_fill_job_pool(num_jobs);
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	JOBS::JOB_QUEUE::load();
+	JOBS::JOB_QUEUE & job_q = JOBS::JOB_QUEUE::get_inst();
+	LIST_QUEUE list_q(job_q.begin(), job_q.end());
+
+	std::cout << num_jobs << " jobs, window of " << window << "\n";
+	size_t list_checksum = 0;
+	size_t queue_checksum = 0;
+
+	CLOCK_TYPE::time_point start = CLOCK_TYPE::now();
+	size_t num_scanned = l_full_passes(list_q, job_pool, list_checksum);
+	l_report("std::list", "full passes", num_scanned, CLOCK_TYPE::now() - start);
+
+	start = CLOCK_TYPE::now();
+	num_scanned = l_full_passes(job_q, job_pool, queue_checksum);
+	l_report("JOB_QUEUE", "full passes", num_scanned, CLOCK_TYPE::now() - start);
+
+	start = CLOCK_TYPE::now();
+	num_scanned = l_dispatch_pattern(list_q, job_pool, window, list_checksum);
+	l_report("std::list", "dispatch", num_scanned, CLOCK_TYPE::now() - start);
+
+	start = CLOCK_TYPE::now();
+	num_scanned = l_dispatch_pattern(job_q, job_pool, window, queue_checksum);
+	l_report("JOB_QUEUE", "dispatch", num_scanned, CLOCK_TYPE::now() - start);
+
+	if (list_checksum != queue_checksum)
+	{
+		std::cerr << "Error: The two queues didn't see the same jobs\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,498 @@
+// Speed and schedule quality regression check. Runs the scheduler on each input, records the time of
+// each phase, the peak RSS and the total cost, and compares them with a baseline file.
+//
+// Each run is a forked child that goes through the same phases as main(), writing the schedule to
+// /dev/null in the binary format. The fastest of --reps runs counts. A run fails if its cost is
+// higher than the baseline's, or if its time or peak RSS grows past the tolerances. Tiny times are
+// noise, so a phase only fails if it's also more than MIN_TIME_SLACK_S slower.
+//
+// Results and baselines are text, one input per line, keyed by the input's file name. See "make
+// regress", which also generates a few large inputs.
+//
+// With --deadline MS, each input is solved under the scheduler's --deadline instead, and fails if
+// its slowest run takes longer. There's no baseline then.
+//
+// Usage: regress [options] input...  (see --help)
+
+#include "io.hh"
+#include "jobs.hh"
+#include "dispatcher.hh"
+#include "options.hh"
+#include "log.hh"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace
+{
+
+typedef std::chrono::steady_clock CLOCK_TYPE;
+
+const double MIN_TIME_SLACK_S = 0.02;
+
+struct REGRESS_OPTIONS
+{
+	std::string baseline_path;
+	std::string results_path;
+	size_t num_reps = 3;
+	size_t num_threads = 1;
+	double time_tolerance = 0.3;
+	double rss_tolerance = 0.2;
+	double cost_tolerance = 0;
+	size_t deadline_ms = 0; // 0 to compare with the baseline instead
+	bool update_baseline = false;
+	std::vector<std::string> input_paths;
+};
+
+enum PHASE { LOAD, DISPATCH, COST, NUM_PHASES };
+const char * const PHASE_NAMES[NUM_PHASES] = {"load", "dispatch", "cost"};
+
+// Handed from the child to the parent through a pipe
+struct RESULT
+{
+	double phase_seconds[NUM_PHASES];
+	long peak_rss_kb;
+	JOBS::COST_CALC::COST cost;
+
+	double get_total_seconds() const
+	{
+		double total = 0;
+		for (double seconds: phase_seconds)
+		{
+			total += seconds;
+		}
+		return total;
+	}
+};
+
+typedef std::map<std::string, RESULT> RESULTS; // By input file name
+
+std::string l_get_file_name(const std::string & path)
+{
+	size_t slash = path.rfind('/');
+	return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+double l_seconds_since(CLOCK_TYPE::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::duration<double>>(CLOCK_TYPE::now() - start).count();
+}
+
+// In the child: the phases of main(), on the input as stdin
+RESULT l_solve(const std::string & input_path, size_t num_threads, size_t deadline_ms)
+{
+	int input_fd = open(input_path.c_str(), O_RDONLY);
+	if (input_fd < 0 || dup2(input_fd, STDIN_FILENO) < 0)
+	{
+		std::cerr << "Error: Can't read " << input_path << "\n";
+		_exit(1);
+	}
+
+	std::string threads = std::to_string(num_threads);
+	std::string deadline = std::to_string(deadline_ms);
+	std::vector<const char *> args = {"regress", "--output-format", "binary", "--output", "/dev/null", "--log-level",
+		"error", "--threads", threads.c_str()};
+	if (deadline_ms > 0)
+	{
+		args.push_back("--deadline");
+		args.push_back(deadline.c_str());
+	}
+	OPTIONS::OPTION_MGR::get_inst().parse(args.size(), const_cast<char **>(args.data()));
+
+	RESULT result = RESULT();
+	CLOCK_TYPE::time_point start = CLOCK_TYPE::now();
+	IO::load_from_stdin();
+	JOBS::JOB_QUEUE::load();
+	result.phase_seconds[LOAD] = l_seconds_since(start);
+
+	start = CLOCK_TYPE::now();
+	DISPATCHER::dispatch_all();
+	result.phase_seconds[DISPATCH] = l_seconds_since(start);
+
+	start = CLOCK_TYPE::now();
+	result.cost = JOBS::COST_CALC::get_total_cost();
+	result.phase_seconds[COST] = l_seconds_since(start);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	result.peak_rss_kb = usage.ru_maxrss;
+	return result;
+}
+
+// Solves the input in a child process, so that every run starts from empty singletons.
+bool l_run_isolated(const std::string & input_path, size_t num_threads, size_t deadline_ms, RESULT & result)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		return false;
+	}
+	std::cout.flush();
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0)
+	{
+		close(fds[0]);
+		RESULT child_result = l_solve(input_path, num_threads, deadline_ms);
+		bool written = write(fds[1], &child_result, sizeof(child_result)) == sizeof(child_result);
+		_exit(written ? 0 : 1);
+	}
+
+	close(fds[1]);
+	ssize_t num_read = read(fds[0], &result, sizeof(result));
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return num_read == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void l_write_results(std::ostream & os, const RESULTS & results)
+{
+	os << "# input";
+	for (const char * phase_name: PHASE_NAMES)
+	{
+		os << " " << phase_name << "_s";
+	}
+	os << " total_s peak_rss_kb cost\n";
+	for (const auto & entry: results)
+	{
+		const RESULT & result = entry.second;
+		os << entry.first << std::fixed << std::setprecision(6);
+		for (double seconds: result.phase_seconds)
+		{
+			os << " " << seconds;
+		}
+		os << " " << result.get_total_seconds() << " " << result.peak_rss_kb << std::defaultfloat
+			<< std::setprecision(std::numeric_limits<JOBS::COST_CALC::COST>::max_digits10) << " " << result.cost << "\n";
+	}
+}
+
+// Lines starting with '#' are comments. The total is recomputed from the phases.
+bool l_read_results(const std::string & path, RESULTS & results)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string input_name;
+		RESULT result = RESULT();
+		double total_seconds = 0;
+		fields >> input_name;
+		for (double & seconds: result.phase_seconds)
+		{
+			fields >> seconds;
+		}
+		fields >> total_seconds >> result.peak_rss_kb >> result.cost;
+		if (!fields)
+		{
+			std::cerr << "Error: Bad line in " << path << ":\n" << line << "\n";
+			return false;
+		}
+		results[input_name] = result;
+	}
+	return true;
+}
+
+// Relative change, as a signed percentage
+std::string l_format_change(double value, double base_value)
+{
+	std::ostringstream os;
+	os << std::showpos << std::fixed << std::setprecision(1)
+		<< (base_value > 0 ? (value - base_value) / base_value * 100 : 0.0) << "%";
+	return os.str();
+}
+
+bool l_time_regressed(double seconds, double base_seconds, double tolerance)
+{
+	return seconds > base_seconds * (1 + tolerance) && seconds > base_seconds + MIN_TIME_SLACK_S;
+}
+
+// Prints one line per input and the reasons it failed. Returns the number of failed inputs.
+size_t l_compare(const RESULTS & results, const RESULTS & baseline, const REGRESS_OPTIONS & options)
+{
+	size_t num_failed = 0;
+	std::cout << std::left << std::setw(20) << "input" << std::right << std::setw(12) << "total_s"
+		<< std::setw(10) << "vs base" << std::setw(14) << "peak_rss_kb" << std::setw(10) << "vs base"
+		<< std::setw(16) << "cost" << std::setw(10) << "vs base" << "\n";
+	for (const auto & entry: results)
+	{
+		const RESULT & result = entry.second;
+		auto base_iter = baseline.find(entry.first);
+		std::cout << std::left << std::setw(20) << entry.first << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(12) << result.get_total_seconds();
+		if (base_iter == baseline.end())
+		{
+			std::cout << std::setw(10) << "" << std::setw(14) << result.peak_rss_kb << std::setw(10) << ""
+				<< std::defaultfloat << std::setprecision(6) << std::setw(16) << result.cost << "  (not in baseline)\n";
+			continue;
+		}
+		const RESULT & base = base_iter->second;
+		std::cout << std::setw(10) << l_format_change(result.get_total_seconds(), base.get_total_seconds())
+			<< std::setw(14) << result.peak_rss_kb << std::setw(10) << l_format_change(result.peak_rss_kb, base.peak_rss_kb)
+			<< std::defaultfloat << std::setprecision(6) << std::setw(16) << result.cost
+			<< std::setw(10) << l_format_change(result.cost, base.cost);
+
+		std::vector<std::string> failures;
+		if (result.cost > base.cost * (1 + options.cost_tolerance))
+		{
+			failures.push_back("cost");
+		}
+		for (size_t phase = 0; phase < NUM_PHASES; ++phase)
+		{
+			if (l_time_regressed(result.phase_seconds[phase], base.phase_seconds[phase], options.time_tolerance))
+			{
+				failures.push_back(std::string(PHASE_NAMES[phase]) + " time");
+			}
+		}
+		if (l_time_regressed(result.get_total_seconds(), base.get_total_seconds(), options.time_tolerance))
+		{
+			failures.push_back("total time");
+		}
+		if (result.peak_rss_kb > base.peak_rss_kb * (1 + options.rss_tolerance))
+		{
+			failures.push_back("peak RSS");
+		}
+
+		for (size_t i = 0; i < failures.size(); ++i)
+		{
+			std::cout << (i == 0 ? "  FAIL: " : ", ") << failures[i];
+		}
+		std::cout << "\n";
+		num_failed += !failures.empty();
+	}
+	return num_failed;
+}
+
+// Returns the number of inputs whose slowest run missed the deadline, or -1 if a run failed.
+int l_check_deadline(const REGRESS_OPTIONS & options)
+{
+	const double deadline_s = options.deadline_ms / 1000.0;
+	int num_failed = 0;
+	std::cout << std::left << std::setw(20) << "input" << std::right << std::setw(12) << "slowest_s"
+		<< std::setw(12) << "deadline_s" << "\n";
+	for (const std::string & input_path: options.input_paths)
+	{
+		double slowest_s = 0;
+		for (size_t rep = 0; rep < options.num_reps; ++rep)
+		{
+			RESULT result;
+			if (!l_run_isolated(input_path, options.num_threads, options.deadline_ms, result))
+			{
+				std::cerr << "Error: The run on " << input_path << " failed\n";
+				return -1;
+			}
+			slowest_s = std::max(slowest_s, result.get_total_seconds());
+		}
+		std::cout << std::left << std::setw(20) << l_get_file_name(input_path) << std::right << std::fixed
+			<< std::setprecision(3) << std::setw(12) << slowest_s << std::setw(12) << deadline_s;
+		if (slowest_s > deadline_s)
+		{
+			std::cout << "  FAIL: missed the deadline";
+			++num_failed;
+		}
+		std::cout << "\n";
+	}
+	return num_failed;
+}
+
+void l_print_usage(const char * exec_name)
+{
+	REGRESS_OPTIONS defaults;
+	std::cerr << "Usage: " << exec_name << " [options] input...\n"
+		<< "  --baseline FILE       Compare with FILE\n"
+		<< "  --results FILE        Write the results to FILE\n"
+		<< "  --update-baseline     Write the results to the baseline file instead of comparing\n"
+		<< "  --reps N              Runs per input, the fastest counts (default " << defaults.num_reps << ")\n"
+		<< "  --threads N           Threads of the scheduler (default " << defaults.num_threads << ")\n"
+		<< "  --time-tolerance F    Allowed relative slowdown (default " << defaults.time_tolerance << ")\n"
+		<< "  --rss-tolerance F     Allowed relative peak RSS growth (default " << defaults.rss_tolerance << ")\n"
+		<< "  --cost-tolerance F    Allowed relative cost growth (default " << defaults.cost_tolerance << ")\n"
+		<< "  --deadline MS         Solve under --deadline MS and fail the inputs not done in time, instead of\n"
+		<< "                        comparing with the baseline\n";
+}
+
+[[noreturn]] void l_bad_usage(const char * exec_name, const std::string & message)
+{
+	std::cerr << "Error: " << message << "\n";
+	l_print_usage(exec_name);
+	exit(1);
+}
+
+REGRESS_OPTIONS l_parse_options(int argc, char ** argv)
+{
+	const char * exec_name = argv[0];
+	REGRESS_OPTIONS options;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option(argv[i]);
+		const char * value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		if (option.compare(0, 2, "--") != 0)
+		{
+			options.input_paths.push_back(option);
+			continue;
+		}
+		if (option == "--help")
+		{
+			l_print_usage(exec_name);
+			exit(0);
+		}
+		if (option == "--update-baseline")
+		{
+			options.update_baseline = true;
+			continue;
+		}
+		if (value == nullptr)
+		{
+			l_bad_usage(exec_name, "Missing value for " + option);
+		}
+		char * end = nullptr;
+		if (option == "--baseline") { options.baseline_path = value; }
+		else if (option == "--results") { options.results_path = value; }
+		else if (option == "--reps" || option == "--threads" || option == "--deadline")
+		{
+			unsigned long number = std::strtoul(value, &end, 10);
+			if (end == value || *end != '\0' || number == 0)
+			{
+				l_bad_usage(exec_name, "Expected a positive number for " + option);
+			}
+			(option == "--reps" ? options.num_reps : option == "--threads" ? options.num_threads : options.deadline_ms) =
+				number;
+		}
+		else if (option == "--time-tolerance" || option == "--rss-tolerance" || option == "--cost-tolerance")
+		{
+			double number = std::strtod(value, &end);
+			if (end == value || *end != '\0' || number < 0)
+			{
+				l_bad_usage(exec_name, "Expected a non negative number for " + option);
+			}
+			(option == "--time-tolerance" ? options.time_tolerance :
+				option == "--rss-tolerance" ? options.rss_tolerance : options.cost_tolerance) = number;
+		}
+		else
+		{
+			l_bad_usage(exec_name, "Unknown option " + option);
+		}
+		++i;
+	}
+	if (options.input_paths.empty())
+	{
+		l_bad_usage(exec_name, "No inputs");
+	}
+	if (options.update_baseline && options.baseline_path.empty())
+	{
+		l_bad_usage(exec_name, "--update-baseline needs --baseline");
+	}
+	if (options.deadline_ms > 0 && (options.update_baseline || !options.baseline_path.empty()))
+	{
+		l_bad_usage(exec_name, "--deadline doesn't go with --baseline or --update-baseline");
+	}
+	return options;
+}
+
+} // End anonymous namespace
+
+int main(int argc, char ** argv)
+{
+	REGRESS_OPTIONS options = l_parse_options(argc, argv);
+	if (options.deadline_ms > 0)
+	{
+		int num_failed = l_check_deadline(options);
+		if (num_failed != 0)
+		{
+			if (num_failed > 0)
+			{
+				std::cout << num_failed << " of " << options.input_paths.size() << " input(s) missed the deadline\n";
+			}
+			return 1;
+		}
+		std::cout << "All " << options.input_paths.size() << " input(s) done within the deadline\n";
+		return 0;
+	}
+
+	RESULTS results;
+	for (const std::string & input_path: options.input_paths)
+	{
+		RESULT best = RESULT();
+		for (size_t rep = 0; rep < options.num_reps; ++rep)
+		{
+			RESULT result;
+			if (!l_run_isolated(input_path, options.num_threads, 0, result))
+			{
+				std::cerr << "Error: The run on " << input_path << " failed\n";
+				return 1;
+			}
+			if (rep > 0 && result.cost != best.cost)
+			{
+				std::cerr << "Error: Two runs on " << input_path << " gave different costs\n";
+				return 1;
+			}
+			if (rep == 0 || result.get_total_seconds() < best.get_total_seconds())
+			{
+				best = result;
+			}
+		}
+		results[l_get_file_name(input_path)] = best;
+	}
+
+	if (!options.results_path.empty())
+	{
+		std::ofstream results_file(options.results_path);
+		l_write_results(results_file, results);
+		if (!results_file)
+		{
+			std::cerr << "Error: Can't write " << options.results_path << "\n";
+			return 1;
+		}
+	}
+
+	if (options.update_baseline)
+	{
+		std::ofstream baseline_file(options.baseline_path);
+		l_write_results(baseline_file, results);
+		std::cout << "Wrote " << results.size() << " result(s) to " << options.baseline_path << "\n";
+		return baseline_file ? 0 : 1;
+	}
+
+	RESULTS baseline;
+	if (!options.baseline_path.empty() && !l_read_results(options.baseline_path, baseline))
+	{
+		std::cerr << "Error: Can't read the baseline " << options.baseline_path << "\n";
+		return 1;
+	}
+	size_t num_failed = l_compare(results, baseline, options);
+	if (num_failed > 0)
+	{
+		std::cout << num_failed << " of " << results.size() << " input(s) regressed\n";
+		return 1;
+	}
+	std::cout << "No regressions in " << results.size() << " input(s)\n";
+	return 0;
+}
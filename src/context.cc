@@ -0,0 +1,125 @@
+
+#include "context.hh"
+#include "jobs.hh"
+#include "cost_engine.hh"
+#include "workers.hh"
+#include "output.hh"
+#include "options.hh"
+#include "thread_pool.hh"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace CONTEXT
+{
+
+thread_local SCHED_CONTEXT * SCHED_CONTEXT::m_current = nullptr;
+
+SCHED_CONTEXT::SCHED_CONTEXT(size_t num_threads, const std::string & output_path)
+: m_num_threads(num_threads), m_output_path(output_path)
+{
+	assert(num_threads > 0);
+}
+
+SCHED_CONTEXT::~SCHED_CONTEXT()
+{
+	assert(m_current != this);
+	delete m_thread_pool;
+	delete m_schedule_writer;
+	delete m_job_queue;
+	delete m_worker_mgr;
+	delete m_cost_engine;
+	delete m_job_pool;
+}
+
+JOBS::JOB_POOL & SCHED_CONTEXT::get_job_pool()
+{
+	if (m_job_pool == nullptr)
+	{
+		m_job_pool = new JOBS::JOB_POOL;
+	}
+	return *m_job_pool;
+}
+
+JOBS::JOB_QUEUE & SCHED_CONTEXT::get_job_queue()
+{
+	assert(m_job_queue != nullptr);
+	return *m_job_queue;
+}
+
+WORKERS::WORKER_MGR & SCHED_CONTEXT::get_worker_mgr()
+{
+	if (m_worker_mgr == nullptr)
+	{
+		m_worker_mgr = new WORKERS::WORKER_MGR;
+	}
+	return *m_worker_mgr;
+}
+
+JOBS::COST_CALC::COST_ENGINE & SCHED_CONTEXT::get_cost_engine()
+{
+	if (m_cost_engine == nullptr)
+	{
+		m_cost_engine = new JOBS::COST_CALC::COST_ENGINE;
+	}
+	return *m_cost_engine;
+}
+
+OUTPUT::SCHEDULE_WRITER & SCHED_CONTEXT::get_schedule_writer()
+{
+	std::string error;
+	if (!open_schedule_writer(error))
+	{
+		std::cerr << "Error: " << error << std::endl;
+		exit(1);
+	}
+	return *m_schedule_writer;
+}
+
+bool SCHED_CONTEXT::open_schedule_writer(std::string & error)
+{
+	if (m_schedule_writer != nullptr)
+	{
+		return true;
+	}
+	int fd = STDOUT_FILENO;
+	if (!m_output_path.empty())
+	{
+		fd = open(m_output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+		{
+			error = "Can't open " + m_output_path + " for writing: " + std::strerror(errno);
+			return false;
+		}
+	}
+	m_schedule_writer = new OUTPUT::SCHEDULE_WRITER(OPTIONS::OPTION_MGR::get_inst().get_output_format(), fd);
+	return true;
+}
+
+THREADS::THREAD_POOL & SCHED_CONTEXT::get_thread_pool()
+{
+	if (m_thread_pool == nullptr)
+	{
+		m_thread_pool = new THREADS::THREAD_POOL(m_num_threads);
+	}
+	return *m_thread_pool;
+}
+
+SCHED_CONTEXT & SCHED_CONTEXT::get_current()
+{
+	if (m_current != nullptr)
+	{
+		return *m_current;
+	}
+	// Like the singletons it replaces, it's never destroyed, so exiting doesn't free every job.
+	static SCHED_CONTEXT * process_context = new SCHED_CONTEXT(OPTIONS::OPTION_MGR::get_inst().get_num_threads(),
+		OPTIONS::OPTION_MGR::get_inst().get_output_path());
+	return *process_context;
+}
+
+} // End namespace CONTEXT
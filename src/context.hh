@@ -0,0 +1,112 @@
+#ifndef CONTEXT_HH
+#define CONTEXT_HH
+
+#include <cstddef>
+#include <string>
+
+namespace JOBS
+{
+class JOB_POOL;
+class JOB_QUEUE;
+namespace COST_CALC
+{
+class COST_ENGINE;
+}
+}
+
+namespace WORKERS
+{
+class WORKER_MGR;
+}
+
+namespace OUTPUT
+{
+class SCHEDULE_WRITER;
+}
+
+namespace THREADS
+{
+class THREAD_POOL;
+}
+
+namespace CONTEXT
+{
+
+// Everything one instance is solved with: its jobs, queue and workers, the cost of the schedule so
+// far, the thread pool the dispatcher evaluates candidates on and where the schedule goes. The
+// get_inst() of each of these returns the one of the context bound to the calling thread, or of a
+// process-wide context built from the command line options if none is. Contexts on different
+// threads don't share anything, so one process can solve several instances at once.
+class SCHED_CONTEXT
+{
+public:
+	SCHED_CONTEXT() = delete;
+	SCHED_CONTEXT(const SCHED_CONTEXT &) = delete;
+	SCHED_CONTEXT(SCHED_CONTEXT &&) = delete;
+	SCHED_CONTEXT & operator=(const SCHED_CONTEXT &) = delete;
+	SCHED_CONTEXT & operator=(SCHED_CONTEXT &&) = delete;
+
+	// The schedule is written to output_path, or to stdout if it's empty. The file is only opened
+	// once something is written.
+	SCHED_CONTEXT(size_t num_threads, const std::string & output_path);
+	~SCHED_CONTEXT();
+
+	// Getters. All but the queue are made on first use.
+	JOBS::JOB_POOL & get_job_pool();
+	bool has_job_queue() const { return m_job_queue != nullptr; }
+	JOBS::JOB_QUEUE & get_job_queue();
+	WORKERS::WORKER_MGR & get_worker_mgr();
+	JOBS::COST_CALC::COST_ENGINE & get_cost_engine();
+	OUTPUT::SCHEDULE_WRITER & get_schedule_writer(); // Exits if the output can't be opened
+
+	// Opens the output now rather than on first use. Returns false, with the reason in error, if it
+	// can't be opened.
+	bool open_schedule_writer(std::string & error);
+	THREADS::THREAD_POOL & get_thread_pool();
+
+	static SCHED_CONTEXT & get_current();
+
+private:
+	friend class JOBS::JOB_QUEUE; // JOB_QUEUE::load() installs the queue
+	friend class SCOPE;
+
+	size_t m_num_threads;
+	std::string m_output_path;
+
+	JOBS::JOB_POOL * m_job_pool = nullptr;
+	JOBS::JOB_QUEUE * m_job_queue = nullptr;
+	WORKERS::WORKER_MGR * m_worker_mgr = nullptr;
+	JOBS::COST_CALC::COST_ENGINE * m_cost_engine = nullptr;
+	OUTPUT::SCHEDULE_WRITER * m_schedule_writer = nullptr;
+	THREADS::THREAD_POOL * m_thread_pool = nullptr;
+
+	static thread_local SCHED_CONTEXT * m_current;
+};
+
+// Binds a context to the calling thread for its lifetime, then puts back whatever was bound before.
+class SCOPE
+{
+public:
+	SCOPE() = delete;
+	SCOPE(const SCOPE &) = delete;
+	SCOPE(SCOPE &&) = delete;
+	SCOPE & operator=(const SCOPE &) = delete;
+	SCOPE & operator=(SCOPE &&) = delete;
+
+	explicit SCOPE(SCHED_CONTEXT & context)
+	: m_previous(SCHED_CONTEXT::m_current)
+	{
+		SCHED_CONTEXT::m_current = &context;
+	}
+	~SCOPE()
+	{
+		SCHED_CONTEXT::m_current = m_previous;
+	}
+
+private:
+	SCHED_CONTEXT * m_previous;
+};
+
+} // End namespace CONTEXT
+
+#endif
@@ -0,0 +1,160 @@
+#include "cost_engine.hh"
+#include "context.hh"
+
+#include <cassert>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace JOBS
+{
+
+namespace COST_CALC
+{
+
+namespace
+{
+
+struct COLUMNS
+{
+	size_t num_jobs;
+	const double * priorities;
+	const double * earliest_start_times;
+	const double * start_times;
+	const double * complete_times;
+};
+
+double l_get_job_cost(const COLUMNS & columns, size_t i)
+{
+	return get_cost(columns.priorities[i], columns.earliest_start_times[i], columns.start_times[i],
+		columns.complete_times[i]);
+}
+
+// The jobs past the last full group of four, in order
+double l_sum_costs_tail(const COLUMNS & columns, size_t begin)
+{
+	double sum = 0;
+	for (size_t i = begin; i < columns.num_jobs; ++i)
+	{
+		sum += l_get_job_cost(columns, i);
+	}
+	return sum;
+}
+
+// Adds in the same order as l_sum_costs_avx2(), four lanes each summing every fourth job, so that
+// both give the same bits and a schedule's cost doesn't depend on the CPU it was evaluated on.
+double l_sum_costs_scalar(const COLUMNS & columns, size_t begin)
+{
+	double lanes[4] = {0, 0, 0, 0};
+	size_t i = begin;
+	for (; i + 4 <= columns.num_jobs; i += 4)
+	{
+		for (size_t lane = 0; lane < 4; ++lane)
+		{
+			lanes[lane] += l_get_job_cost(columns, i + lane);
+		}
+	}
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + l_sum_costs_tail(columns, i);
+}
+
+#if defined(__x86_64__)
+// Same, four jobs at a time. Every job's cost comes out the same as get_cost(): the sqrt is
+// correctly rounded either way, and without -mfma nothing is fused.
+__attribute__((target("avx2")))
+double l_sum_costs_avx2(const COLUMNS & columns, size_t begin)
+{
+	__m256d sums = _mm256_setzero_pd();
+	size_t i = begin;
+	for (; i + 4 <= columns.num_jobs; i += 4)
+	{
+		__m256d priority = _mm256_loadu_pd(columns.priorities + i);
+		__m256d complete_time = _mm256_loadu_pd(columns.complete_times + i);
+		__m256d wait = _mm256_sub_pd(complete_time, _mm256_loadu_pd(columns.earliest_start_times + i));
+		__m256d span = _mm256_sub_pd(complete_time, _mm256_loadu_pd(columns.start_times + i));
+		__m256d norm = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(wait, wait), _mm256_mul_pd(span, span)));
+		sums = _mm256_add_pd(sums, _mm256_mul_pd(priority, norm));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, sums);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + l_sum_costs_tail(columns, i);
+}
+#endif
+
+typedef double (*SUM_COSTS_FUNC)(const COLUMNS &, size_t);
+
+// Picked once, by what the CPU running the binary supports
+SUM_COSTS_FUNC l_get_sum_costs()
+{
+#if defined(__x86_64__)
+	static const SUM_COSTS_FUNC sum_costs = __builtin_cpu_supports("avx2") ? l_sum_costs_avx2 : l_sum_costs_scalar;
+	return sum_costs;
+#else
+	return l_sum_costs_scalar;
+#endif
+}
+
+} // End anonymous namespace
+
+void COST_ENGINE::commit_job(const JOB_ENTRY & job)
+{
+	const JOB_IDX job_idx = job.get_index();
+	if (job_idx >= m_priorities.size())
+	{
+		grow();
+	}
+	assert(job.get_status().submitted());
+	assert(m_complete_times[job_idx] == m_earliest_start_times[job_idx]); // Not committed yet
+	m_start_times[job_idx] = job.get_status().get_start_time();
+	m_complete_times[job_idx] = job.get_status().get_complete_time();
+	m_total_cost += get_job_cost(job_idx);
+	++m_num_committed;
+}
+
+void COST_ENGINE::revert_job(const JOB_ENTRY & job)
+{
+	const JOB_IDX job_idx = job.get_index();
+	assert(job_idx < m_priorities.size());
+	assert(m_complete_times[job_idx] != m_earliest_start_times[job_idx]); // Committed
+	m_total_cost -= get_job_cost(job_idx);
+	m_start_times[job_idx] = m_earliest_start_times[job_idx];
+	m_complete_times[job_idx] = m_earliest_start_times[job_idx];
+	--m_num_committed;
+}
+
+double COST_ENGINE::get_job_cost(JOB_IDX job_idx) const
+{
+	assert(job_idx < m_priorities.size());
+	return get_cost(m_priorities[job_idx], m_earliest_start_times[job_idx], m_start_times[job_idx],
+		m_complete_times[job_idx]);
+}
+
+double COST_ENGINE::evaluate() const
+{
+	const COLUMNS columns{m_priorities.size(), m_priorities.data(), m_earliest_start_times.data(),
+		m_start_times.data(), m_complete_times.data()};
+	return l_get_sum_costs()(columns, 0);
+}
+
+void COST_ENGINE::grow()
+{
+	const JOB_POOL & job_pool = JOB_POOL::get_inst();
+	assert(job_pool.is_ready());
+	for (JOB_IDX job_idx = m_priorities.size(); job_idx < job_pool.size(); ++job_idx)
+	{
+		const JOB_ENTRY job = job_pool[job_idx];
+		m_priorities.push_back(job.get_priority());
+		m_earliest_start_times.push_back(job.get_earliest_start_time());
+		m_start_times.push_back(job.get_earliest_start_time());
+		m_complete_times.push_back(job.get_earliest_start_time());
+	}
+}
+
+COST_ENGINE & COST_ENGINE::get_inst()
+{
+	return CONTEXT::SCHED_CONTEXT::get_current().get_cost_engine();
+}
+
+} // End namespace COST_CALC
+
+} // End namespace JOBS
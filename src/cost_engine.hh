@@ -0,0 +1,75 @@
+#ifndef COST_ENGINE_HH
+#define COST_ENGINE_HH
+
+#include "jobs.hh"
+
+#include <vector>
+#include <cmath>
+
+namespace JOBS
+{
+
+namespace COST_CALC
+{
+
+// What one job costs, given where it ended up
+inline double get_cost(double priority, double earliest_start_time, double start_time, double complete_time)
+{
+	double wait = complete_time - earliest_start_time;
+	double span = complete_time - start_time;
+	return priority * std::sqrt(wait * wait + span * span);
+}
+
+// The objective over every job of the current context, kept in columns of its own so that a full
+// evaluation is one vectorized pass over contiguous memory. Times are stored as doubles, which is
+// exact below 2^53, and everything is summed in double.
+//
+// WORKER_MGR commits a job once all of its subtasks are placed and reverts it when it takes the job
+// out again, and the running total follows along. A job that isn't committed has its start and
+// complete times at its earliest start time, so it costs nothing.
+class COST_ENGINE
+{
+public:
+	COST_ENGINE(const COST_ENGINE &) = delete;
+	COST_ENGINE(COST_ENGINE &&) = delete;
+	COST_ENGINE & operator=(const COST_ENGINE &) = delete;
+	COST_ENGINE & operator=(COST_ENGINE &&) = delete;
+
+	// Modifiers
+	void commit_job(const JOB_ENTRY & job); // Its status must be submitted
+	void revert_job(const JOB_ENTRY & job);
+
+	// Getters
+	double get_job_cost(JOB_IDX job_idx) const;
+	double get_total_cost() const { return m_total_cost; }
+	size_t get_num_committed() const { return m_num_committed; }
+	// Sums every job again. The running total may be off from it by rounding after many reverts.
+	double evaluate() const;
+
+	static COST_ENGINE & get_inst();
+
+private:
+	friend class CONTEXT::SCHED_CONTEXT;
+
+	COST_ENGINE() = default;
+	~COST_ENGINE() = default;
+
+	// Takes in the jobs the pool got since, which in streaming mode keep coming. The pool must be
+	// sorted already, since sorting moves jobs to other indices.
+	void grow();
+
+	// Columns, indexed by job index
+	std::vector<double> m_priorities;
+	std::vector<double> m_earliest_start_times;
+	std::vector<double> m_start_times;
+	std::vector<double> m_complete_times;
+
+	double m_total_cost = 0;
+	size_t m_num_committed = 0;
+};
+
+} // End namespace COST_CALC
+
+} // End namespace JOBS
+
+#endif
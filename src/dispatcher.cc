@@ -1,12 +1,26 @@
 
 #include "dispatcher.hh"
+#include "context.hh"
 #include "jobs.hh"
 #include "workers.hh"
+#include "cost_engine.hh"
+#include "local_search.hh"
+#include "options.hh"
+#include "thread_pool.hh"
+#include "output.hh"
+#include "log.hh"
+#include "trace.hh"
+#include "stats.hh"
 
 #include <vector>
 #include <cassert>
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <atomic>
+#include <chrono>
 
 namespace DISPATCHER
 {
@@ -17,15 +31,45 @@ typedef JOB_QUEUE::ITER JOBQ_ITER;
 namespace
 {
 
+// What pick_best_job_to_execute() minimizes. It only grows with the ETA.
+float l_get_pick_cost(float eta, float priority, float priority_exponent)
+{
+	return (priority_exponent == 1) ? eta / priority : eta / std::pow(priority, priority_exponent);
+}
+
+// Cheap admissible bound on the cost pick_best_job_to_execute() would compute for the job. No
+// worker runs two subtasks at once, so one of them runs ceil(num_subtasks / num_workers) of them
+// back to back, none of which can start before the job's earliest start time.
+float l_get_cost_lower_bound(const JOBS::JOB_ENTRY & job, size_t num_workers, float priority_exponent)
+{
+	size_t num_rounds = (job.get_num_subtasks() + num_workers - 1) / num_workers;
+	float eta_lower_bound = job.get_earliest_start_time() + num_rounds * job.get_subtask_duration();
+	float priority = job.get_priority();
+	return l_get_pick_cost(eta_lower_bound, priority, priority_exponent);
+}
+
+} // End anonymous namespace
 
-JOBQ_ITER l_pick_best_job_to_execute()
+// Candidates are projected in batches on the thread pool, against the workers as they are right now
+// (nothing writes to them until the pick is dispatched). The batches are then reduced in queue
+// order, so the pick and the number of jobs tried are the same for any number of threads.
+//
+// A job whose cost lower bound isn't below the best cost seen so far can't be picked, so it's not
+// projected at all. Batches are cut at one projection per thread so that the best cost is as fresh
+// as possible when the bounds are checked.
+JOBQ_ITER pick_best_job_to_execute(THREADS::THREAD_POOL & thread_pool)
+{
+	return pick_best_job_to_execute(thread_pool, OPTIONS::OPTION_MGR::get_inst().get_dispatch_config().look_ahead);
+}
+
+JOBQ_ITER pick_best_job_to_execute(THREADS::THREAD_POOL & thread_pool, size_t num_new_attempts)
 {
 	const size_t MAX_NUM_JOBS_TO_TRY = std::numeric_limits<size_t>::max();; // TODO: QoR Tuning
-	bool debug = false;
 
 	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
 
 	JOB_QUEUE & job_q = JOB_QUEUE::get_inst();
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
 
 	JOBS::JOB_QUEUE::ITER job_iter = job_q.begin();
 	assert(job_iter != job_q.end());
@@ -35,95 +79,409 @@ JOBQ_ITER l_pick_best_job_to_execute()
 	float smallest_cost_seen = std::numeric_limits<float>::max();
 	JOBS::JOB_QUEUE::ITER best_job_iter;
 
-	size_t num_new_attempts = 20;
+	const OPTIONS::DISPATCH_CONFIG & config = OPTIONS::OPTION_MGR::get_inst().get_dispatch_config();
+	const float priority_exponent = config.priority_exponent;
 	size_t look_ahead = num_new_attempts;
 
-	while (job_iter != job_q.end() && num_jobs_tried < MAX_NUM_JOBS_TO_TRY)
-	{
+	const size_t num_workers = worker_mgr.size();
 
-		float eta = worker_mgr.get_projected_job_status(job_iter->get()).get_complete_time();
-		float priority = job_iter->get().get_priority();
-		float cost = eta / priority; // TODO: QoR Tuning
+	// Kept across calls so that picking a job doesn't allocate. The lambda below runs on other
+	// threads, so it must capture these rather than name the thread_locals.
+	static thread_local std::vector<JOBQ_ITER> batch_storage;
+	static thread_local std::vector<float> batch_etas_storage;
+	static thread_local std::vector<size_t> batch_idxs_to_project_storage;
+	std::vector<JOBQ_ITER> & batch = batch_storage;
+	std::vector<float> & batch_etas = batch_etas_storage;
+	std::vector<size_t> & batch_idxs_to_project = batch_idxs_to_project_storage;
+	bool give_up = false;
 
-		if (cost < smallest_cost_seen)
+	// Passed to parallel_for by reference, which std::function stores without allocating. The
+	// projection reaches for the context's singletons, so the pool's threads must see it too.
+	CONTEXT::SCHED_CONTEXT & context = CONTEXT::SCHED_CONTEXT::get_current();
+	auto project = [&context, &worker_mgr, &job_pool, &batch, &batch_etas, &batch_idxs_to_project](size_t i)
+	{
+		CONTEXT::SCOPE context_scope(context);
+		size_t batch_idx = batch_idxs_to_project[i];
+		batch_etas[batch_idx] = worker_mgr.get_cached_projected_job_status(job_pool[*batch[batch_idx]]).get_complete_time();
+	};
+
+	while (!give_up && job_iter != job_q.end() && num_jobs_tried < MAX_NUM_JOBS_TO_TRY)
+	{
+		// Unless a better job shows up, every job up to one past the look-ahead gets tried anyway. So
+		// none of the batch is wasted.
+		size_t batch_size = std::min(look_ahead + 2 - num_jobs_tried, MAX_NUM_JOBS_TO_TRY - num_jobs_tried);
+		batch.clear();
+		batch_idxs_to_project.clear();
+		for (JOBQ_ITER iter = job_iter;
+			iter != job_q.end() && batch.size() < batch_size && batch_idxs_to_project.size() < thread_pool.size();
+			++iter)
 		{
-			smallest_cost_seen = cost;
-			best_job_iter = job_iter;
-			picked_attempt = num_jobs_tried;
-			look_ahead = num_jobs_tried + num_new_attempts;
+			if (l_get_cost_lower_bound(job_pool[*iter], num_workers, priority_exponent) < smallest_cost_seen)
+			{
+				batch_idxs_to_project.push_back(batch.size());
+			}
+			batch.push_back(iter);
 		}
+		SCHED_STAT_ADD(JOBS_CONSIDERED, batch.size());
+		SCHED_STAT_ADD(PROJECTIONS_PRUNED, batch.size() - batch_idxs_to_project.size());
+
+		// Pruned jobs keep an infinite ETA, which never beats smallest_cost_seen.
+		batch_etas.assign(batch.size(), std::numeric_limits<float>::infinity());
+		thread_pool.parallel_for(batch_idxs_to_project.size(), std::ref(project));
 
-		if ( num_jobs_tried > look_ahead ) // TODO: QoR Tuning
+		for (size_t i = 0; i < batch.size(); ++i)
 		{
-			// Not a good sign. Better give up.
+			float eta = batch_etas[i];
+			float priority = job_pool[*job_iter].get_priority();
+			float cost = l_get_pick_cost(eta, priority, priority_exponent);
 
-			// TODO: Collect the following stats:
-			//  - num_jobs_tried / picked_attempt ratio
-			//  - cost / smallest_cost_seen ratio
-			break;
-		}
+			if (cost < smallest_cost_seen)
+			{
+				smallest_cost_seen = cost;
+				best_job_iter = job_iter;
+				picked_attempt = num_jobs_tried;
+				look_ahead = num_jobs_tried + num_new_attempts;
+			}
 
-		if (debug)
-		{
-			std::cout << "Tested job " << job_iter->get().to_string()
-				<< " ETA=" << eta << " Cost=" << cost << " Best Cost=" << smallest_cost_seen << std::endl;
-		}
+			if ( num_jobs_tried > look_ahead ) // TODO: QoR Tuning
+			{
+				// Not a good sign. Better give up.
 
-		++job_iter;
-		++num_jobs_tried;
+				// Pruned jobs have an infinite cost, which says nothing about how close the search was.
+				if (cost != std::numeric_limits<float>::infinity())
+				{
+					SCHED_STAT_RECORD(GIVE_UP_COST_PERCENT, uint64_t(100 * cost / smallest_cost_seen));
+				}
+				give_up = true;
+				break;
+			}
+
+			SCHED_LOG(TRACE) << "Tested job " << job_pool[*job_iter].to_string()
+				<< " ETA=" << eta << " Cost=" << cost << " Best Cost=" << smallest_cost_seen;
+
+			++job_iter;
+			++num_jobs_tried;
+		}
 	}
-	std::cout << "Tried " << num_jobs_tried << " jobs out of " << job_q.size() << ". Picked attempt #" << picked_attempt << std::endl;
+	SCHED_LOG(DEBUG) << "Tried " << num_jobs_tried << " jobs out of " << job_q.size() << ". Picked attempt #" << picked_attempt;
+	SCHED_TRACE(DISPATCH, *best_job_iter, num_jobs_tried, picked_attempt);
+	SCHED_STAT_RECORD(JOBS_TRIED_PER_DISPATCH, num_jobs_tried);
+	SCHED_STAT_RECORD(PICKED_ATTEMPT, picked_attempt);
 
 	return best_job_iter;
 }
 
-// Send job to workers and dequeue it.
-void l_dispatch(JOBQ_ITER jobq_iter)
+namespace
+{
+
+THREADS::THREAD_POOL & l_get_thread_pool()
+{
+	return CONTEXT::SCHED_CONTEXT::get_current().get_thread_pool();
+}
+
+// Send job to workers and dequeue it. In streaming mode, where each subtask went is printed right
+// away. With append, the job goes through WORKER_MGR::append_job() instead.
+void l_dispatch(JOBQ_ITER jobq_iter, bool append = false)
 {
-	bool debug = true;
 	JOB_QUEUE & job_q = JOB_QUEUE::get_inst();
 	assert(jobq_iter != job_q.cend());
-	JOBS::JOB_ENTRY & job = jobq_iter->get();
+	JOBS::JOB_ENTRY job = JOBS::JOB_POOL::get_inst()[*jobq_iter];
 	auto & worker_mgr = WORKERS::WORKER_MGR::get_inst();
-	worker_mgr.submit_job(job, job.get_modifiable_status());
-	if (debug) std::cout << "Dispatched job " << job.to_string() << std::endl;
+	if (OPTIONS::OPTION_MGR::get_inst().is_streaming())
+	{
+		WORKERS::WORKER_MGR::PLACEMENTS placements;
+		worker_mgr.submit_job(job, job.get_modifiable_status(), &placements);
+		OUTPUT::SCHEDULE_WRITER & schedule_writer = OUTPUT::SCHEDULE_WRITER::get_inst();
+		for (const WORKERS::WORKER_MGR::PLACEMENT & placement: placements)
+		{
+			schedule_writer.write_subtask(job, placement.worker_idx, placement.start_time);
+		}
+		schedule_writer.flush();
+	}
+	else if (append)
+	{
+		worker_mgr.append_job(job, job.get_modifiable_status());
+	}
+	else
+	{
+		worker_mgr.submit_job(job, job.get_modifiable_status());
+	}
+	SCHED_STAT_ADD(DISPATCHES, 1);
+	SCHED_LOG(DEBUG) << "Dispatched job " << job.to_string();
 	job_q.erase(jobq_iter);
-	//std::cout << "Workers:\n" << worker_mgr;
-	//std::cout << "Job Q:\n" << job_q;
 
 }
 
 } // End anonymous namespace
 
-void dispatch_all()
+// A queued job is settled once its projected completion time is no later than the watermark: jobs
+// still to come can't start before it, so they can't compete for any slot the job would take. When
+// the queue grows past the stream window, the best job goes out anyway to bound the latency.
+void dispatch_settled(JOBS::TIME watermark)
+{
+	auto & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	JOBS::JOB_QUEUE & job_q = JOBS::JOB_QUEUE::get_inst();
+	const size_t max_queued_jobs = OPTIONS::OPTION_MGR::get_inst().get_stream_window();
+	THREADS::THREAD_POOL & thread_pool = l_get_thread_pool();
+
+	worker_mgr.resize_projection_cache(JOBS::JOB_POOL::get_inst().size());
+	while (!job_q.empty())
+	{
+		JOBQ_ITER best_job = pick_best_job_to_execute(thread_pool);
+		JOBS::TIME eta = worker_mgr.get_cached_projected_job_status(JOBS::JOB_POOL::get_inst()[*best_job]).get_complete_time();
+		if (eta > watermark && job_q.size() <= max_queued_jobs)
+		{
+			break;
+		}
+		l_dispatch(best_job);
+	}
+}
+
+namespace
+{
+
+typedef std::chrono::steady_clock CLOCK_TYPE;
+
+// Under --deadline, writing the schedule is set aside this long per subtask, about twice what it
+// takes on a recent x86 core (by OUTPUT::SCHEDULE_WRITER::FORMAT). So is a margin for the rest of
+// the run. Dispatching must be done by a fraction of the time that's left, and improving by the end
+// of it. The local search isn't started unless it has time to set up and then make moves.
+const std::chrono::nanoseconds WRITE_TIME_PER_SUBTASK[] = {
+	std::chrono::nanoseconds(500), std::chrono::nanoseconds(300), std::chrono::nanoseconds(200)};
+const std::chrono::nanoseconds IMPROVE_SETUP_TIME_PER_SUBTASK(200);
+const float MARGIN_BUDGET_FRACTION = 0.1;
+const float DISPATCH_BUDGET_FRACTION = 0.8;
+
+size_t l_get_num_subtasks()
+{
+	const JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	size_t num_subtasks = 0;
+	for (JOBS::JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+	{
+		num_subtasks += job_pool[job_idx].get_num_subtasks();
+	}
+	return num_subtasks;
+}
+
+// Decides how hard each pick tries so that the queue is empty by the deadline. The time per pick
+// at the current level is measured, and as soon as the jobs left would take longer than the time
+// left at that pace, the next level is used. Picks get cheaper as the queue shrinks, so the guess
+// errs on the safe side; levels never go back down. Queue order picks are appended to the workers
+// (see WORKER_MGR::append_job()), so they're cheap enough to finish past the deadline.
+class PACER
 {
-	bool debug = true;
-	const auto & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+public:
+	enum LEVEL { FULL, NARROW, MINIMAL, QUEUE_ORDER, NUM_LEVELS };
+
+	PACER() = delete;
+	PACER(const PACER &) = delete;
+	PACER(PACER &&) = delete;
+	PACER & operator=(const PACER &) = delete;
+	PACER & operator=(PACER &&) = delete;
+	~PACER() = default;
+
+	explicit PACER(CLOCK_TYPE::time_point deadline)
+	: m_deadline(deadline), m_level_start(CLOCK_TYPE::now())
+	{
+	}
+
+	// Modifiers
+	JOBQ_ITER pick(THREADS::THREAD_POOL & thread_pool)
+	{
+		JOB_QUEUE & job_q = JOB_QUEUE::get_inst();
+		update_level(job_q.size());
+		++m_num_picks[m_level];
+		++m_num_picks_at_level;
+		size_t look_ahead = OPTIONS::OPTION_MGR::get_inst().get_dispatch_config().look_ahead;
+		switch (m_level)
+		{
+		case FULL: return pick_best_job_to_execute(thread_pool, look_ahead);
+		case NARROW: return pick_best_job_to_execute(thread_pool, std::max<size_t>(look_ahead / 4, 1));
+		case MINIMAL: return pick_best_job_to_execute(thread_pool, 0);
+		case QUEUE_ORDER: break;
+		case NUM_LEVELS: assert(false); break;
+		}
+		return job_q.begin();
+	}
+
+	// Getters
+	LEVEL get_level() const { return m_level; }
+	size_t get_num_picks(LEVEL level) const { return m_num_picks[level]; }
+
+	static const char * get_level_name(LEVEL level)
+	{
+		switch (level)
+		{
+		case FULL: return "full look-ahead";
+		case NARROW: return "quarter look-ahead";
+		case MINIMAL: return "no look-ahead";
+		case QUEUE_ORDER: return "queue order";
+		case NUM_LEVELS: break;
+		}
+		assert(false);
+		return "";
+	}
+
+private:
+	// A few picks are timed before the pace at a new level is trusted
+	static constexpr size_t MIN_PICKS_TO_MEASURE = 4;
+
+	void update_level(size_t num_jobs_left)
+	{
+		CLOCK_TYPE::time_point now = CLOCK_TYPE::now();
+		while (m_level + 1 < NUM_LEVELS)
+		{
+			bool out_of_time = now >= m_deadline;
+			if (!out_of_time && m_num_picks_at_level < MIN_PICKS_TO_MEASURE)
+			{
+				return;
+			}
+			CLOCK_TYPE::duration time_per_pick = (now - m_level_start) / std::max<size_t>(m_num_picks_at_level, 1);
+			if (!out_of_time && now + time_per_pick * num_jobs_left <= m_deadline)
+			{
+				return;
+			}
+			m_level = LEVEL(m_level + 1);
+			m_level_start = now;
+			m_num_picks_at_level = 0;
+			SCHED_LOG(INFO) << "Deadline: " << num_jobs_left << " jobs left, going on with " << get_level_name(m_level);
+		}
+	}
+
+	CLOCK_TYPE::time_point m_deadline;
+	LEVEL m_level = FULL;
+	CLOCK_TYPE::time_point m_level_start;
+	size_t m_num_picks_at_level = 0;
+	size_t m_num_picks[NUM_LEVELS] = {};
+};
+
+// Dispatches the whole queue, unless the cost of the jobs dispatched so far goes over the bound,
+// if any. The bound is read again after each job, as other processes may lower it. Returns whether
+// it got through.
+bool l_dispatch_queue(const std::atomic<JOBS::COST_CALC::COST> * cost_bound, PACER * pacer)
+{
+	auto & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
 	JOBS::JOB_QUEUE & job_q = JOBS::JOB_QUEUE::get_inst();
-	if (job_q.empty())
+	if (job_pool.empty())
 	{
 		std::cerr << "No jobs to dispatch. Quitting...\n";
 		exit(1);
 	}
-	std::cout << "Start dispatching jobs to workers...\n";
+	worker_mgr.resize_projection_cache(job_pool.size());
+	THREADS::THREAD_POOL & thread_pool = l_get_thread_pool();
+	SCHED_LOG(INFO) << "Start dispatching jobs to workers on " << thread_pool.size() << " thread(s)...";
+	const JOBS::COST_CALC::COST_ENGINE & cost_engine = JOBS::COST_CALC::COST_ENGINE::get_inst();
 	while (!job_q.empty())
 	{
-		JOBQ_ITER best_job = l_pick_best_job_to_execute();
-		l_dispatch(best_job);
+		JOBQ_ITER best_job = (pacer != nullptr) ? pacer->pick(thread_pool) : pick_best_job_to_execute(thread_pool);
+		l_dispatch(best_job, pacer != nullptr && pacer->get_level() == PACER::QUEUE_ORDER);
+		if (cost_bound != nullptr)
+		{
+			JOBS::COST_CALC::COST bound = cost_bound->load(std::memory_order_relaxed);
+			if (cost_engine.get_total_cost() > bound)
+			{
+				SCHED_LOG(INFO) << "Gave up with " << job_q.size() << " jobs left: cost is already over " << bound;
+				return false;
+			}
+		}
+	}
+
+	// Checking every worker's history costs as much as a good share of a tight deadline
+	assert(pacer != nullptr || worker_mgr.execution_history_is_legal());
+
+	SCHED_LOG(INFO) << "Done dispatching!";
+
+	// Nothing else runs now, so the per-thread counters add up exactly.
+	const WORKERS::NODE_POOL & node_pool = worker_mgr.get_history_node_pool();
+	SCHED_STAT_ADD(HISTORY_NODE_ALLOCATIONS, node_pool.get_num_node_allocations());
+	SCHED_STAT_ADD(HISTORY_SLAB_ALLOCATIONS, node_pool.get_num_slab_allocations());
+	if (SCHED_STATS_ENABLED) // Or the counters were never kept
+	{
+		uint64_t num_cache_hits = STATS::STATS_MGR::get_counter(STATS::COUNTER::PROJECTION_CACHE_HITS);
+		uint64_t num_cache_misses = STATS::STATS_MGR::get_counter(STATS::COUNTER::PROJECTION_CACHE_MISSES);
+		uint64_t num_projections = num_cache_hits + num_cache_misses;
+		SCHED_LOG(INFO) << "ETA cache: " << num_cache_hits << " hits, " << num_cache_misses << " misses ("
+			<< (num_projections ? 100.0 * num_cache_hits / num_projections : 0.0) << "% reused)";
+		SCHED_LOG(INFO) << "Lower bound pruning: skipped "
+			<< STATS::STATS_MGR::get_counter(STATS::COUNTER::PROJECTIONS_PRUNED) << " of "
+			<< STATS::STATS_MGR::get_counter(STATS::COUNTER::JOBS_CONSIDERED) << " projections";
+	}
+	SCHED_LOG(INFO) << "History nodes: " << node_pool.get_num_node_allocations() << " allocated from "
+		<< node_pool.get_num_slab_allocations() << " slab(s), "
+		<< float(node_pool.get_num_slab_allocations()) / job_pool.size() << " heap allocations per job";
+	return true;
+}
+
+} // End anonymous namespace
+
+// With a deadline, improving gets whatever time dispatching left, up to --improve if given. The
+// deadline counts from the start of the run, loading included.
+void dispatch_all()
+{
+	const OPTIONS::OPTION_MGR & options = OPTIONS::OPTION_MGR::get_inst();
+	if (options.get_deadline_ms() == 0)
+	{
+		l_dispatch_queue(nullptr, nullptr);
+		if (options.is_improving())
+		{
+			LOCAL_SEARCH::improve(options.get_improve_seconds(), options.get_improve_moves());
+			assert(WORKERS::WORKER_MGR::get_inst().execution_history_is_legal());
+		}
+		write_schedule();
+		return;
 	}
 
-	assert(worker_mgr.execution_history_is_legal());
+	const size_t num_subtasks = l_get_num_subtasks();
+	const std::chrono::duration<float> budget = std::chrono::milliseconds(options.get_deadline_ms());
+	const std::chrono::duration<float> write_time =
+		WRITE_TIME_PER_SUBTASK[size_t(OUTPUT::SCHEDULE_WRITER::get_inst().get_format())] * num_subtasks;
+	const std::chrono::duration<float> work_time =
+		std::max(budget * (1 - MARGIN_BUDGET_FRACTION) - write_time, std::chrono::duration<float>::zero());
+	const CLOCK_TYPE::time_point start = options.get_parse_time();
+	SCHED_LOG(INFO) << "Deadline: " << options.get_deadline_ms() << "ms, of which "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(write_time).count() << "ms set aside for writing";
+	if (work_time.count() == 0)
+	{
+		SCHED_LOG(WARNING) << "Deadline: writing the schedule alone may take longer, dispatching in queue order";
+	}
+	PACER pacer(start + std::chrono::duration_cast<CLOCK_TYPE::duration>(work_time * DISPATCH_BUDGET_FRACTION));
+	l_dispatch_queue(nullptr, &pacer);
+	SCHED_LOG(INFO) << "Deadline: dispatched at worst with " << PACER::get_level_name(pacer.get_level()) << " ("
+		<< pacer.get_num_picks(PACER::FULL) << " full, "
+		<< pacer.get_num_picks(PACER::NARROW) << " quarter, "
+		<< pacer.get_num_picks(PACER::MINIMAL) << " no look-ahead, "
+		<< pacer.get_num_picks(PACER::QUEUE_ORDER) << " queue order picks)";
+
+	std::chrono::duration<float> improve_time =
+		(start + std::chrono::duration_cast<CLOCK_TYPE::duration>(work_time)) - CLOCK_TYPE::now();
+	if (options.get_improve_seconds() > 0)
+	{
+		improve_time = std::min(improve_time, std::chrono::duration<float>(options.get_improve_seconds()));
+	}
+	if (improve_time > std::chrono::duration<float>(IMPROVE_SETUP_TIME_PER_SUBTASK * num_subtasks))
+	{
+		LOCAL_SEARCH::improve(improve_time.count(), options.get_improve_moves());
+	}
+	write_schedule();
+}
 
-	std::cout << "Done dispatching!\n";
+bool dispatch_all_below(const std::atomic<JOBS::COST_CALC::COST> & cost_bound)
+{
+	return l_dispatch_queue(&cost_bound, nullptr);
+}
 
-	if (debug)
+void write_schedule()
+{
+	// Streaming mode already wrote every subtask in the compact formats
+	OUTPUT::SCHEDULE_WRITER & schedule_writer = OUTPUT::SCHEDULE_WRITER::get_inst();
+	bool is_compact = schedule_writer.get_format() != OUTPUT::SCHEDULE_WRITER::FORMAT::TEXT;
+	bool already_written = is_compact && OPTIONS::OPTION_MGR::get_inst().is_streaming();
+	if (!already_written)
 	{
-		std::cout << "Here's the subtask history on each machine: \n";
-		std::cout << worker_mgr;
-		//TODO: Check all jobs are executed once and only once. Write some more checks.
-		std::cout << "Here's the overall job status after dispatching all:\n";
-		std::cout << JOBS::JOB_POOL::get_inst();
+		schedule_writer.write_schedule(WORKERS::WORKER_MGR::get_inst());
 	}
+	schedule_writer.flush();
 }
 
 
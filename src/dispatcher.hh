@@ -2,11 +2,33 @@
 #ifndef DISPATCHER_HH
 #define DISPATCHER_HH
 
+#include "jobs.hh"
+
+#include <atomic>
+
+namespace THREADS
+{
+class THREAD_POOL;
+}
 
 namespace DISPATCHER
 {
 
+// Dispatches the whole queue, then runs LOCAL_SEARCH::improve() if asked for. Under --deadline, it
+// makes picks cheaper as the deadline nears.
 void dispatch_all();
+void dispatch_settled(JOBS::TIME watermark); // Streaming mode, between two reads
+// Dispatches the queue for a portfolio run. It gives up, leaving jobs in the queue and returning
+// false, as soon as the cost of the jobs it dispatched goes over the bound. The bound may be lowered
+// meanwhile.
+bool dispatch_all_below(const std::atomic<JOBS::COST_CALC::COST> & cost_bound);
+void write_schedule();
+
+// The queued job that's cheapest to dispatch next, against the workers as they are now. The queue
+// must not be empty. Both dispatch functions go through this; it's exposed for the benchmarks.
+// The search stops look_ahead jobs past the best one so far, or the configured number if not given.
+JOBS::JOB_QUEUE::ITER pick_best_job_to_execute(THREADS::THREAD_POOL & thread_pool);
+JOBS::JOB_QUEUE::ITER pick_best_job_to_execute(THREADS::THREAD_POOL & thread_pool, size_t look_ahead);
 
 
 } // End namespace DISPATCHER
@@ -0,0 +1,324 @@
+#ifndef HOLE_INDEX_HH
+#define HOLE_INDEX_HH
+
+#include "jobs.hh"
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+namespace WORKERS
+{
+
+// Ordered index of the free holes in one worker's execution history.
+//
+// A hole is a half-open idle interval [start, end). Holes never overlap, so they're keyed by start.
+// The trailing idle time after the last subtask is stored as a hole ending at HOLE_INDEX::INF_TIME.
+// Each hole carries a payload (the worker stores the iterator of the subtask that closes the hole).
+//
+// Backed by a treap whose nodes live in a vector and are linked by 32-bit indices. Every node is
+// annotated with the max hole length of its subtree, which lets find_earliest_fit() skip subtrees
+// where nothing is long enough. All operations are expected O(log n).
+template <typename PAYLOAD>
+class HOLE_INDEX
+{
+public:
+	typedef uint32_t NODE_IDX;
+	static constexpr JOBS::TIME INF_TIME = std::numeric_limits<JOBS::TIME>::max();
+	static constexpr NODE_IDX NIL = std::numeric_limits<NODE_IDX>::max();
+
+	struct HOLE
+	{
+		JOBS::TIME start;
+		JOBS::TIME end;
+		PAYLOAD payload;
+
+		JOBS::TIME length() const { return end - start; }
+		bool is_tail() const { return end == INF_TIME; }
+	};
+
+	HOLE_INDEX() = default;
+	HOLE_INDEX(const HOLE_INDEX &) = default;
+	HOLE_INDEX(HOLE_INDEX &&) = default;
+	HOLE_INDEX & operator=(const HOLE_INDEX &) = default;
+	HOLE_INDEX & operator=(HOLE_INDEX &&) = default;
+	~HOLE_INDEX() = default;
+
+	// Getters
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	// Hole starting exactly at start, or nullptr.
+	const HOLE * find(JOBS::TIME start) const
+	{
+		NODE_IDX cur = m_root;
+		while (cur != NIL)
+		{
+			const NODE & node = m_nodes[cur];
+			if (start == node.hole.start) { return &node.hole; }
+			cur = (start < node.hole.start) ? node.left : node.right;
+		}
+		return nullptr;
+	}
+
+	// Last hole starting before time, or nullptr.
+	const HOLE * find_last_before(JOBS::TIME time) const
+	{
+		size_t num_visited = 0;
+		return (time == 0) ? nullptr : find_last_starting_at_or_before(time - 1, num_visited);
+	}
+
+	// Length of the longest hole starting before time, or 0 if none.
+	JOBS::TIME get_max_length_before(JOBS::TIME time) const
+	{
+		JOBS::TIME max_length = 0;
+		NODE_IDX cur = m_root;
+		while (cur != NIL)
+		{
+			const NODE & node = m_nodes[cur];
+			if (node.hole.start < time)
+			{
+				max_length = std::max(max_length, std::max(node.hole.length(), subtree_max_length(node.left)));
+				cur = node.right;
+			}
+			else
+			{
+				cur = node.left;
+			}
+		}
+		return max_length;
+	}
+
+	// Earliest hole where a piece of work of the given duration fits, when it's not allowed to start
+	// before earliest_start. Returns the hole and the start time within it, or nullptr if none. If
+	// num_visited isn't null, the number of tree nodes the search went through is added to it.
+	std::pair<const HOLE *, JOBS::TIME> find_earliest_fit(JOBS::TIME earliest_start, JOBS::TIME duration,
+		size_t * num_visited = nullptr) const
+	{
+		assert(duration > 0);
+		size_t num_visited_here = 0;
+
+		// Only the last hole starting at or before earliest_start can contain it. Holes before that
+		// one end before earliest_start.
+		const HOLE * containing = find_last_starting_at_or_before(earliest_start, num_visited_here);
+		if (containing != nullptr &&
+			containing->end > earliest_start &&
+			containing->end - earliest_start >= duration)
+		{
+			if (num_visited != nullptr) { *num_visited += num_visited_here; }
+			return std::make_pair(containing, earliest_start);
+		}
+
+		NODE_IDX fit = find_first_fit_after(m_root, earliest_start, duration, num_visited_here);
+		if (num_visited != nullptr) { *num_visited += num_visited_here; }
+		if (fit == NIL)
+		{
+			return std::make_pair(nullptr, earliest_start);
+		}
+		return std::make_pair(&m_nodes[fit].hole, m_nodes[fit].hole.start);
+	}
+
+	// Modifiers
+	void insert(JOBS::TIME start, JOBS::TIME end, PAYLOAD payload)
+	{
+		assert(start < end);
+		assert(find(start) == nullptr);
+
+		NODE_IDX new_node = alloc_node();
+		NODE & node = m_nodes[new_node];
+		node.hole.start = start;
+		node.hole.end = end;
+		node.hole.payload = payload;
+		node.max_length = end - start;
+
+		NODE_IDX left = NIL;
+		NODE_IDX right = NIL;
+		split(m_root, start, left, right);
+		m_root = merge(merge(left, new_node), right);
+		++m_size;
+	}
+
+	void erase(JOBS::TIME start)
+	{
+		NODE_IDX left = NIL;
+		NODE_IDX mid = NIL;
+		NODE_IDX right = NIL;
+		split(m_root, start, left, right);
+		split(right, start + 1, mid, right);
+		assert(mid != NIL);
+		assert(m_nodes[mid].left == NIL && m_nodes[mid].right == NIL);
+		free_node(mid);
+		m_root = merge(left, right);
+		--m_size;
+	}
+
+	void clear()
+	{
+		m_nodes.clear();
+		m_free_nodes.clear();
+		m_root = NIL;
+		m_size = 0;
+	}
+
+private:
+	struct NODE
+	{
+		HOLE hole;
+		JOBS::TIME max_length;
+		NODE_IDX left;
+		NODE_IDX right;
+		uint32_t priority;
+	};
+
+	NODE_IDX alloc_node()
+	{
+		NODE_IDX idx;
+		if (!m_free_nodes.empty())
+		{
+			idx = m_free_nodes.back();
+			m_free_nodes.pop_back();
+		}
+		else
+		{
+			assert(m_nodes.size() < NIL);
+			idx = NODE_IDX(m_nodes.size());
+			m_nodes.emplace_back();
+		}
+		NODE & node = m_nodes[idx];
+		node.left = NIL;
+		node.right = NIL;
+		node.priority = next_priority();
+		return idx;
+	}
+
+	void free_node(NODE_IDX idx)
+	{
+		m_free_nodes.push_back(idx);
+	}
+
+	// xorshift32. Deterministic so that runs are reproducible.
+	uint32_t next_priority()
+	{
+		m_rand_state ^= m_rand_state << 13;
+		m_rand_state ^= m_rand_state >> 17;
+		m_rand_state ^= m_rand_state << 5;
+		return m_rand_state;
+	}
+
+	JOBS::TIME subtree_max_length(NODE_IDX idx) const
+	{
+		return (idx == NIL) ? 0 : m_nodes[idx].max_length;
+	}
+
+	void update(NODE_IDX idx)
+	{
+		NODE & node = m_nodes[idx];
+		node.max_length = std::max(node.hole.length(),
+			std::max(subtree_max_length(node.left), subtree_max_length(node.right)));
+	}
+
+	// Split into holes starting before key, and holes starting at or after key.
+	void split(NODE_IDX idx, JOBS::TIME key, NODE_IDX & left, NODE_IDX & right)
+	{
+		if (idx == NIL)
+		{
+			left = NIL;
+			right = NIL;
+			return;
+		}
+		if (m_nodes[idx].hole.start < key)
+		{
+			split(m_nodes[idx].right, key, m_nodes[idx].right, right);
+			left = idx;
+		}
+		else
+		{
+			split(m_nodes[idx].left, key, left, m_nodes[idx].left);
+			right = idx;
+		}
+		update(idx);
+	}
+
+	// Every key in left must be smaller than every key in right.
+	NODE_IDX merge(NODE_IDX left, NODE_IDX right)
+	{
+		if (left == NIL) { return right; }
+		if (right == NIL) { return left; }
+		if (m_nodes[left].priority > m_nodes[right].priority)
+		{
+			m_nodes[left].right = merge(m_nodes[left].right, right);
+			update(left);
+			return left;
+		}
+		else
+		{
+			m_nodes[right].left = merge(left, m_nodes[right].left);
+			update(right);
+			return right;
+		}
+	}
+
+	const HOLE * find_last_starting_at_or_before(JOBS::TIME time, size_t & num_visited) const
+	{
+		const HOLE * best = nullptr;
+		NODE_IDX cur = m_root;
+		while (cur != NIL)
+		{
+			++num_visited;
+			const NODE & node = m_nodes[cur];
+			if (node.hole.start <= time)
+			{
+				best = &node.hole;
+				cur = node.right;
+			}
+			else
+			{
+				cur = node.left;
+			}
+		}
+		return best;
+	}
+
+	// Leftmost hole starting strictly after time, whose length is at least duration.
+	NODE_IDX find_first_fit_after(NODE_IDX idx, JOBS::TIME time, JOBS::TIME duration, size_t & num_visited) const
+	{
+		if (idx == NIL || m_nodes[idx].max_length < duration)
+		{
+			return NIL;
+		}
+		++num_visited;
+		const NODE & node = m_nodes[idx];
+		if (node.hole.start <= time)
+		{
+			return find_first_fit_after(node.right, time, duration, num_visited);
+		}
+		NODE_IDX fit = find_first_fit_after(node.left, time, duration, num_visited);
+		if (fit != NIL)
+		{
+			return fit;
+		}
+		if (node.hole.length() >= duration)
+		{
+			return idx;
+		}
+		return find_first_fit_after(node.right, time, duration, num_visited);
+	}
+
+	std::vector<NODE> m_nodes;
+	std::vector<NODE_IDX> m_free_nodes;
+	NODE_IDX m_root = NIL;
+	size_t m_size = 0;
+	uint32_t m_rand_state = 2463534242u;
+};
+
+template <typename PAYLOAD>
+constexpr JOBS::TIME HOLE_INDEX<PAYLOAD>::INF_TIME;
+
+template <typename PAYLOAD>
+constexpr typename HOLE_INDEX<PAYLOAD>::NODE_IDX HOLE_INDEX<PAYLOAD>::NIL;
+
+} // End namespace WORKERS
+
+#endif
@@ -1,15 +1,28 @@
 
+#include "io.hh"
 #include "jobs.hh"
 #include "workers.hh"
 #include "dispatcher.hh"
+#include "options.hh"
+#include "thread_pool.hh"
+#include "log.hh"
 
 #include <iostream>
 #include <string>
-#include <regex>
+#include <vector>
+#include <limits>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <cerrno>
 
 #include <chrono>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 
 namespace IO
 {
@@ -18,77 +31,350 @@ namespace IO
 namespace
 {
 
-// TODO: index should be separated from this
-JOBS::JOB_ENTRY l_string_to_job_entry(const std::string & line)
+// Input files are read in blocks of this size when they can't be mapped
+const size_t READ_BLOCK_SIZE = 1 << 20;
+
+// Below this size, splitting the input across threads isn't worth it
+const size_t MIN_BYTES_PER_PARSE_THREAD = 4 << 20;
+
+// Whole contents of a file descriptor. Regular files are mmapped, anything else (pipes, terminals) is
+// read in large blocks.
+class INPUT_BUFFER
+{
+public:
+	INPUT_BUFFER() = delete;
+	INPUT_BUFFER(const INPUT_BUFFER &) = delete;
+	INPUT_BUFFER(INPUT_BUFFER &&) = delete;
+	INPUT_BUFFER & operator=(const INPUT_BUFFER &) = delete;
+	INPUT_BUFFER & operator=(INPUT_BUFFER &&) = delete;
+
+	explicit INPUT_BUFFER(int fd)
+	{
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0)
+		{
+			void * mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED)
+			{
+				madvise(mapped, file_stat.st_size, MADV_SEQUENTIAL);
+				m_mapped = static_cast<const char *>(mapped);
+				m_size = file_stat.st_size;
+				return;
+			}
+		}
+
+		while (true)
+		{
+			size_t old_size = m_read_buffer.size();
+			m_read_buffer.resize(old_size + READ_BLOCK_SIZE);
+			ssize_t num_read = read(fd, m_read_buffer.data() + old_size, READ_BLOCK_SIZE);
+			if (num_read < 0 && errno == EINTR)
+			{
+				m_read_buffer.resize(old_size);
+				continue;
+			}
+			if (num_read < 0)
+			{
+				std::cerr << "Error: Failed to read input: " << std::strerror(errno) << std::endl;
+				exit(1);
+			}
+			m_read_buffer.resize(old_size + num_read);
+			if (num_read == 0)
+			{
+				break;
+			}
+		}
+		m_size = m_read_buffer.size();
+	}
+
+	~INPUT_BUFFER()
+	{
+		if (m_mapped != nullptr)
+		{
+			munmap(const_cast<char *>(m_mapped), m_size);
+		}
+	}
+
+	const char * data() const { return (m_mapped != nullptr) ? m_mapped : m_read_buffer.data(); }
+	size_t size() const { return m_size; }
+
+private:
+	const char * m_mapped = nullptr;
+	std::vector<char> m_read_buffer;
+	size_t m_size = 0;
+};
+
+// A job or worker line, with its name still pointing into the input buffer.
+struct PARSED_JOB
+{
+	const char * name;
+	size_t name_length;
+	size_t num_subtasks;
+	JOBS::TIME subtask_duration;
+	JOBS::TIME earliest_start_time;
+	JOBS::PRIORITY priority;
+};
+
+struct PARSED_WORKER
 {
-	std::regex regex("(\\w+) (\\w+) (\\d+) (\\d+) (\\d+) (\\d+)");
-	std::smatch match;
-	std::regex_search(line, match, regex);
+	const char * name;
+	size_t name_length;
+};
+
+// Everything parsed out of one chunk of the input, in input order.
+struct PARSED_CHUNK
+{
+	std::vector<PARSED_JOB> jobs;
+	std::vector<PARSED_WORKER> workers;
+	const char * bad_line = nullptr; // First line that failed to parse, if any
+	const char * bad_line_end = nullptr;
+};
 
-	assert(match.size() == 7);
-	assert(match[1] == "job");
+bool l_is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
 
-	JOBS::JOB_ENTRY job(match[2], std::stoul(match[6]), std::stoul(match[3]), std::stoul(match[5]), std::stoul(match[4]));
-	return job;
+// Same as \w in the old regex based parser
+bool l_is_word_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
 }
 
-// TODO: index should be separated from this
-WORKERS::WORKER l_string_to_worker_entry(const std::string & line, WORKERS::WORKER::WORKER_IDX idx)
+// Tokenizer over one line. Every getter skips leading blanks, and returns false if the next token
+// isn't what was asked for.
+class LINE_TOKENIZER
 {
-	std::regex regex("(\\w+) (\\w+)");
-	std::smatch match;
-	std::regex_search(line, match, regex);
+public:
+	LINE_TOKENIZER(const char * begin, const char * end)
+	: m_cur(begin), m_end(end)
+	{
 
-	assert(match.size() == 3);
-	assert(match[1] == "worker");
+	}
 
-	WORKERS::WORKER worker(match[2], idx);
-	return worker;
+	bool get_word(const char * & word, size_t & length)
+	{
+		skip_spaces();
+		const char * word_begin = m_cur;
+		while (m_cur != m_end && l_is_word_char(*m_cur)) { ++m_cur; }
+		word = word_begin;
+		length = m_cur - word_begin;
+		return length > 0 && (m_cur == m_end || l_is_space(*m_cur));
+	}
+
+	bool get_number(size_t & number)
+	{
+		skip_spaces();
+		const char * number_begin = m_cur;
+		number = 0;
+		while (m_cur != m_end && *m_cur >= '0' && *m_cur <= '9')
+		{
+			size_t digit = *m_cur - '0';
+			if (number > (std::numeric_limits<size_t>::max() - digit) / 10) { return false; }
+			number = number * 10 + digit;
+			++m_cur;
+		}
+		return m_cur != number_begin && (m_cur == m_end || l_is_space(*m_cur));
+	}
+
+	bool at_end()
+	{
+		skip_spaces();
+		return m_cur == m_end;
+	}
+
+private:
+	void skip_spaces()
+	{
+		while (m_cur != m_end && l_is_space(*m_cur)) { ++m_cur; }
+	}
+
+	const char * m_cur;
+	const char * m_end;
+};
+
+bool l_word_equals(const char * word, size_t length, const char * expected)
+{
+	return length == std::strlen(expected) && std::memcmp(word, expected, length) == 0;
 }
 
+// Returns false if the line is neither blank, nor a well formed job or worker line
+bool l_parse_line(const char * begin, const char * end, PARSED_CHUNK & chunk)
+{
+	LINE_TOKENIZER tokenizer(begin, end);
+	if (tokenizer.at_end())
+	{
+		return true;
+	}
+
+	const char * keyword;
+	size_t keyword_length;
+	if (!tokenizer.get_word(keyword, keyword_length))
+	{
+		return false;
+	}
 
+	if (l_word_equals(keyword, keyword_length, "job"))
+	{
+		// job <name> <num subtasks> <subtask duration> <earliest start time> <priority>
+		PARSED_JOB job;
+		bool good =
+			tokenizer.get_word(job.name, job.name_length) &&
+			tokenizer.get_number(job.num_subtasks) &&
+			tokenizer.get_number(job.subtask_duration) &&
+			tokenizer.get_number(job.earliest_start_time) &&
+			tokenizer.get_number(job.priority) &&
+			tokenizer.at_end();
+		if (!good || job.num_subtasks == 0 || job.subtask_duration == 0 || job.priority == 0)
+		{
+			return false;
+		}
+		chunk.jobs.push_back(job);
+		return true;
+	}
+	else if (l_word_equals(keyword, keyword_length, "worker"))
+	{
+		// worker <name>
+		PARSED_WORKER worker;
+		if (!tokenizer.get_word(worker.name, worker.name_length) || !tokenizer.at_end())
+		{
+			return false;
+		}
+		chunk.workers.push_back(worker);
+		return true;
+	}
+	return false;
 }
 
+// [begin, end) must start at a line start and end right after a newline, or at the end of input.
+void l_parse_chunk(const char * begin, const char * end, PARSED_CHUNK & chunk)
+{
+	const char * line_begin = begin;
+	while (line_begin < end)
+	{
+		const char * line_end = static_cast<const char *>(std::memchr(line_begin, '\n', end - line_begin));
+		if (line_end == nullptr)
+		{
+			line_end = end;
+		}
+		if (!l_parse_line(line_begin, line_end, chunk))
+		{
+			chunk.bad_line = line_begin;
+			chunk.bad_line_end = line_end;
+			return;
+		}
+		line_begin = line_end + 1;
+	}
+}
 
-void load_from_stdin()
+
+// Streaming mode: queue the jobs of a chunk right away. Returns the new watermark, i.e. the
+// earliest start time of the last job seen.
+JOBS::TIME l_admit_chunk(const PARSED_CHUNK & chunk, JOBS::TIME watermark)
 {
-	std::cout << "Start reading from stdin!" << std::endl;
 	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	JOBS::JOB_QUEUE & job_q = JOBS::JOB_QUEUE::get_inst();
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
 
-	while (std::cin.good())
+	if (chunk.bad_line != nullptr)
 	{
-		std::string line;
-		std::getline(std::cin, line);
-		if (line.empty()) { continue; }
-		//std::cout << line << std::endl;
-		std::regex regex("(^\\w+)");
-		std::smatch match;
-		std::regex_search(line, match, regex);
-
-		assert(!match.empty());
-
-		if (match[0] == "job")
+		std::cerr << "Error: Unexpected line from input file:\n";
+		std::cerr << std::string(chunk.bad_line, chunk.bad_line_end) << std::endl;
+		exit(1);
+	}
+	for (const PARSED_WORKER & worker: chunk.workers)
+	{
+		if (!job_pool.empty())
 		{
-			job_pool.add_job(l_string_to_job_entry(line));
+			std::cerr << "Error: In streaming mode, all workers must come before the first job\n";
+			exit(1);
 		}
-		else if (match[0] == "worker")
+		WORKERS::WORKER::WORKER_IDX new_idx = worker_mgr.size();
+		worker_mgr.add_worker(WORKERS::WORKER(std::string(worker.name, worker.name_length), new_idx,
+			worker_mgr.get_history_node_pool()));
+	}
+	for (const PARSED_JOB & job: chunk.jobs)
+	{
+		if (worker_mgr.empty())
 		{
-			WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
-			WORKERS::WORKER::WORKER_IDX new_idx = worker_mgr.size();
-			worker_mgr.add_worker(l_string_to_worker_entry(line, new_idx));
+			std::cerr << "Error: In streaming mode, all workers must come before the first job\n";
+			exit(1);
 		}
-		else
+		if (job.earliest_start_time < watermark)
 		{
-			std::cerr << "Error: Unexpected line from input file:\n";
-			std::cerr << line << std::endl;
+			std::cerr << "Error: In streaming mode, jobs must come in order of earliest start time. Job "
+				<< std::string(job.name, job.name_length) << " can start at " << job.earliest_start_time
+				<< ", but a job that came before it can't start before " << watermark << std::endl;
 			exit(1);
 		}
+		watermark = job.earliest_start_time;
+		job_q.add_job(job_pool.add_indexed_job(job.name, job.name_length, job.priority, job.num_subtasks,
+			job.earliest_start_time, job.subtask_duration));
 	}
+	return watermark;
+}
 
-	job_pool.sort_and_create_index();
 
-	//std::cout << "Done parsing! Here's the results:" << std::endl;
-	//std::cout << JOBS::JOB_POOL::get_inst();
+}
+
+
+// Streaming mode: reads stdin as it comes in, and lets the dispatcher commit whatever jobs are
+// settled after each read. Doesn't wait for EOF, so it works on pipes that stay open.
+void stream_from_stdin()
+{
+	SCHED_LOG(INFO) << "Start streaming from stdin!";
+	JOBS::JOB_QUEUE::load_empty();
+
+	std::vector<char> buffer;
+	size_t num_pending_bytes = 0; // Unfinished last line from previous reads
+	JOBS::TIME watermark = 0;
+
+	while (true)
+	{
+		buffer.resize(num_pending_bytes + READ_BLOCK_SIZE);
+		ssize_t num_read = read(STDIN_FILENO, buffer.data() + num_pending_bytes, READ_BLOCK_SIZE);
+		if (num_read < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (num_read < 0)
+		{
+			std::cerr << "Error: Failed to read input: " << std::strerror(errno) << std::endl;
+			exit(1);
+		}
+		if (num_read == 0)
+		{
+			break;
+		}
+
+		const char * begin = buffer.data();
+		const char * end = begin + num_pending_bytes + num_read;
+		const char * last_line_end = begin;
+		for (const char * iter = end; iter != begin; --iter)
+		{
+			if (*(iter - 1) == '\n')
+			{
+				last_line_end = iter;
+				break;
+			}
+		}
+
+		PARSED_CHUNK chunk;
+		l_parse_chunk(begin, last_line_end, chunk);
+		watermark = l_admit_chunk(chunk, watermark);
+
+		num_pending_bytes = end - last_line_end;
+		std::memmove(buffer.data(), last_line_end, num_pending_bytes);
+
+		if (!JOBS::JOB_QUEUE::get_inst().empty())
+		{
+			DISPATCHER::dispatch_settled(watermark);
+		}
+	}
+
+	PARSED_CHUNK chunk;
+	l_parse_chunk(buffer.data(), buffer.data() + num_pending_bytes, chunk);
+	l_admit_chunk(chunk, watermark);
 
 	if (JOBS::JOB_POOL::get_inst().empty())
 	{
@@ -102,36 +388,115 @@ void load_from_stdin()
 	}
 }
 
-}
+namespace
+{
 
-class FUNC_TIMER
+// Reads all of the file descriptor into the current context's JOB_POOL and WORKER_MGR, parsing on up
+// to num_threads threads. Returns false, with the message in error, if the input is bad.
+bool l_load(int fd, size_t num_threads, std::string & error)
 {
-public:
 	typedef std::chrono::steady_clock CLOCK_TYPE;
-	FUNC_TIMER()
-	: m_start(CLOCK_TYPE::now())
+	CLOCK_TYPE::time_point start_time = CLOCK_TYPE::now();
+
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+
+	INPUT_BUFFER input(fd);
+	const char * input_begin = input.data();
+	const char * input_end = input_begin + input.size();
+
+	// Cut the input into one chunk per thread, at line boundaries.
+	size_t num_chunks = std::max<size_t>(1, std::min(num_threads, input.size() / MIN_BYTES_PER_PARSE_THREAD));
+	std::vector<const char *> chunk_begins(1, input_begin);
+	for (size_t i = 1; i < num_chunks; ++i)
 	{
+		const char * cut = std::max(chunk_begins.back(), input_begin + input.size() / num_chunks * i);
+		const char * newline = static_cast<const char *>(std::memchr(cut, '\n', input_end - cut));
+		chunk_begins.push_back((newline == nullptr) ? input_end : newline + 1);
+	}
+	chunk_begins.push_back(input_end);
 
+	std::vector<PARSED_CHUNK> chunks(num_chunks);
+	THREADS::THREAD_POOL thread_pool(num_chunks);
+	thread_pool.parallel_for(num_chunks,
+		[&chunk_begins, &chunks](size_t i)
+		{
+			l_parse_chunk(chunk_begins[i], chunk_begins[i + 1], chunks[i]);
+		});
+
+	float parse_seconds = std::chrono::duration_cast<std::chrono::duration<float>>(CLOCK_TYPE::now() - start_time).count();
+	float megabytes = input.size() / float(1 << 20);
+	SCHED_LOG(INFO) << "Parsed " << megabytes << " MB in " << parse_seconds << "s ("
+		<< (parse_seconds > 0 ? megabytes / parse_seconds : 0) << " MB/s) on " << num_chunks << " thread(s)";
+
+	// Jobs and workers are each kept in input order
+	for (const PARSED_CHUNK & chunk: chunks)
+	{
+		if (chunk.bad_line != nullptr)
+		{
+			error = "Error: Unexpected line from input file:\n" + std::string(chunk.bad_line, chunk.bad_line_end) + "\n";
+			return false;
+		}
+		for (const PARSED_JOB & job: chunk.jobs)
+		{
+			job_pool.add_job(job.name, job.name_length, job.priority, job.num_subtasks,
+				job.earliest_start_time, job.subtask_duration);
+		}
+		for (const PARSED_WORKER & worker: chunk.workers)
+		{
+			WORKERS::WORKER::WORKER_IDX new_idx = worker_mgr.size();
+			worker_mgr.add_worker(WORKERS::WORKER(std::string(worker.name, worker.name_length), new_idx,
+				worker_mgr.get_history_node_pool()));
+		}
 	}
-	~FUNC_TIMER()
+
+	float load_seconds = std::chrono::duration_cast<std::chrono::duration<float>>(CLOCK_TYPE::now() - start_time).count();
+	SCHED_LOG(INFO) << "Loaded " << job_pool.size() << " jobs and " << worker_mgr.size() << " workers in "
+		<< load_seconds << "s";
+
+	job_pool.sort_and_create_index();
+
+	SCHED_LOG(TRACE) << "Done parsing! Here's the results:\n" << JOBS::JOB_POOL::get_inst();
+
+	if (job_pool.empty())
 	{
-		CLOCK_TYPE::duration duration = CLOCK_TYPE::now() - m_start;
-		std::cout << "FUNC_TIMER: " << std::chrono::duration_cast<std::chrono::duration<float>>(duration).count() << "s\n";
+		error = "No jobs to do. Quitting...";
+		return false;
 	}
-	FUNC_TIMER(const FUNC_TIMER &) = delete;
-	FUNC_TIMER(FUNC_TIMER &&) = delete;
-	FUNC_TIMER & operator=(const FUNC_TIMER &) = delete;
-	FUNC_TIMER & operator=(FUNC_TIMER &&) = delete;
-private:
-	CLOCK_TYPE::time_point m_start;
-};
+	if (worker_mgr.empty())
+	{
+		error = "No workers found. Quitting...";
+		return false;
+	}
+	return true;
+}
+
+}
 
-int main()
+void load_from_stdin()
 {
-	FUNC_TIMER timer;
-	IO::load_from_stdin();
-	JOBS::JOB_QUEUE::load();
-	DISPATCHER::dispatch_all();
-	JOBS::COST_CALC::get_total_cost();
-	return 0;
+	SCHED_LOG(INFO) << "Start reading from stdin!";
+	std::string error;
+	if (!l_load(STDIN_FILENO, OPTIONS::OPTION_MGR::get_inst().get_num_threads(), error))
+	{
+		std::cerr << error;
+		exit(1);
+	}
 }
+
+bool load_from_file(const std::string & path, std::string & error)
+{
+	SCHED_LOG(INFO) << "Start reading from " << path << "!";
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		error = "Error: Can't open " + path + ": " + std::strerror(errno);
+		return false;
+	}
+	bool loaded = l_load(fd, 1, error);
+	close(fd);
+	return loaded;
+}
+
+
+} // End namespace IO
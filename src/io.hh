@@ -0,0 +1,22 @@
+
+#ifndef IO_HH
+#define IO_HH
+
+#include <string>
+
+namespace IO
+{
+
+// Reads all of stdin into JOB_POOL and WORKER_MGR, then sorts and indexes the jobs.
+void load_from_stdin();
+
+// Same, from a file and on one thread. Returns false, with the message in error, if the file can't be
+// read or isn't a valid input.
+bool load_from_file(const std::string & path, std::string & error);
+
+// Streaming mode: reads stdin as it comes in, and dispatches settled jobs after each read.
+void stream_from_stdin();
+
+} // End namespace IO
+
+#endif
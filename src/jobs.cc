@@ -1,11 +1,16 @@
 
 #include "jobs.hh"
+#include "cost_engine.hh"
 #include "workers.hh"
+#include "context.hh"
+#include "options.hh"
+#include "log.hh"
 
 #include <algorithm>
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <limits>
 
 
 
@@ -13,12 +18,27 @@ namespace JOBS
 {
 
 // Global Variabl Declarations /////////////////////////////////////////////////////////////////////
-JOB_QUEUE * JOB_QUEUE::m_job_queue_inst = nullptr;
-JOB_POOL * JOB_POOL::m_instance = nullptr;
+constexpr JOB_QUEUE::JOB_Q_ENTRY JOB_QUEUE::TOMBSTONE;
+constexpr JOB_QUEUE::JOB_Q_ENTRY JOB_QUEUE::SENTINEL;
+constexpr size_t JOB_QUEUE::MAX_ERASE_SHIFT;
 
 // Anonymous Namesoace /////////////////////////////////////////////////////////////////////////////
 namespace
 {
+
+// Reorders a column so that element i is the one that was at order[i].
+template <typename T>
+void l_permute(std::vector<T> & column, const std::vector<JOB_IDX> & order)
+{
+	std::vector<T> permuted;
+	permuted.reserve(column.size());
+	for (JOB_IDX idx: order)
+	{
+		permuted.push_back(std::move(column[idx]));
+	}
+	column.swap(permuted);
+}
+
 // TODO: These need QoR Tuning
 
 // Early cost - a way we weigh jobs without putting them onto the workers.
@@ -33,46 +53,66 @@ float l_get_job_early_cost(const JOB_ENTRY & job)
 	return cost;
 }
 
-// Ordering policy used by JOB_QUEUE. Returns true if lhs should be placed before rhs.
-bool l_job_queue_order_less_than(const JOB_ENTRY & lhs, const JOB_ENTRY & rhs)
+// Weighted shortest processing time: all the work of the job, per unit of priority.
+float l_get_job_weighted_work(const JOB_ENTRY & job)
 {
+	float work = float(job.get_num_subtasks()) * job.get_subtask_duration();
+	return work / job.get_priority();
+}
 
+// Order of JOB_POOL, which gives the jobs their indices. Returns true if lhs should be placed before
+// rhs.
+bool l_job_early_cost_less_than(const JOB_ENTRY & lhs, const JOB_ENTRY & rhs)
+{
 	return bool( l_get_job_early_cost(lhs) <
 		l_get_job_early_cost(rhs) );
 }
 
+// Ordering policy used by JOB_QUEUE. Returns true if lhs should be placed before rhs. Other orders
+// than the early cost fall back on it for ties.
+bool l_job_queue_order_less_than(const JOB_ENTRY & lhs, const JOB_ENTRY & rhs)
+{
+	switch (OPTIONS::OPTION_MGR::get_inst().get_dispatch_config().queue_order)
+	{
+	case OPTIONS::QUEUE_ORDER::EARLY_COST:
+		break;
+	case OPTIONS::QUEUE_ORDER::EARLIEST_START:
+		if (lhs.get_earliest_start_time() != rhs.get_earliest_start_time())
+		{
+			return lhs.get_earliest_start_time() < rhs.get_earliest_start_time();
+		}
+		break;
+	case OPTIONS::QUEUE_ORDER::WSPT:
+		if (l_get_job_weighted_work(lhs) != l_get_job_weighted_work(rhs))
+		{
+			return l_get_job_weighted_work(lhs) < l_get_job_weighted_work(rhs);
+		}
+		break;
+	}
+	return l_job_early_cost_less_than(lhs, rhs);
+}
+
 
 } // End anonymous namespace
 
 namespace COST_CALC
 {
 
-COST get_cost_for_job(const JOB_ENTRY & job)
-{
-	COST priority = job.get_priority();
-	COST earliest = job.get_earliest_start_time();
-	assert(job.get_status().submitted());
-	COST start = job.get_status().get_start_time();
-	COST end = job.get_status().get_complete_time();
-	assert(start < end);
-	assert(earliest <= start);
-	COST cost = priority * std::sqrt( std::pow((end - earliest), 2) + std::pow((end - start), 2) );
-	return cost;
-}
-
 COST get_total_cost()
 {
-	bool debug = true;
-	if (debug) std::cout << "Calculating total cost of jobs...\n";
+	SCHED_LOG(INFO) << "Calculating total cost of jobs...";
 	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
-	COST sum_cost = 0.0;
-	for (const JOB_ENTRY & job: job_pool)
+	const COST_ENGINE & cost_engine = COST_ENGINE::get_inst();
+	assert(cost_engine.get_num_committed() == job_pool.size());
+	if (LOG::LOGGER::is_enabled(LOG::LEVEL::DEBUG))
 	{
-		COST cost = get_cost_for_job(job);
-		sum_cost += cost;
-		if (debug) std::cout << job.to_string() << " cost=" << cost << std::endl;
+		for (JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+		{
+			SCHED_LOG(DEBUG) << job_pool[job_idx].to_string() << " cost=" << cost_engine.get_job_cost(job_idx);
+		}
 	}
-	if (debug) std::cout << "Sum Cost: " << sum_cost << std::endl;
+	double sum_cost = cost_engine.evaluate();
+	SCHED_LOG(INFO) << "Sum Cost: " << sum_cost;
 	return sum_cost;
 }
 
@@ -82,7 +122,7 @@ COST get_total_cost()
 
 // Class Routines //////////////////////////////////////////////////////////////////////////////////
 
-const JOB_ENTRY & JOB_STATUS::get_job() const
+JOB_ENTRY JOB_STATUS::get_job() const
 {
 	assert(parent_set);
 	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
@@ -94,7 +134,7 @@ void JOB_STATUS::reset()
 {
 	m_start_time = std::numeric_limits<JOBS::TIME>::max();
 	m_complete_time = std::numeric_limits<JOBS::TIME>::min();
-	m_subtasks.clear();
+	m_num_subtasks = 0;
 }
 
 void JOB_STATUS::set_parent(JOB_IDX idx)
@@ -109,12 +149,12 @@ bool JOB_STATUS::submitted() const
 	assert(parent_set);
 	//std::cout << get_job().to_string() << std::endl;
 	assert(get_job().get_num_subtasks() > 0);
-	return m_subtasks.size() == get_job().get_num_subtasks();
+	return m_num_subtasks == get_job().get_num_subtasks();
 }
 
 bool JOB_STATUS::is_clean() const
 {
-	return m_subtasks.empty();
+	return m_num_subtasks == 0;
 }
 
 TIME JOB_STATUS::get_start_time() const
@@ -127,81 +167,92 @@ TIME JOB_STATUS::get_complete_time() const
 	return m_complete_time;
 }
 
-void JOB_STATUS::add_subtask(const WORKERS::SUBTASK & subtask)
+void JOB_STATUS::add_subtask(TIME start_time, TIME complete_time)
 {
-	m_subtasks.push_back(subtask);
-	assert(m_subtasks.size() <= get_job().get_num_subtasks());
-	m_start_time = std::min(m_start_time, subtask.get_start_time());
-	m_complete_time = std::max(m_complete_time, subtask.get_complete_time());
+	++m_num_subtasks;
+	assert(m_num_subtasks <= get_job().get_num_subtasks());
+	m_start_time = std::min(m_start_time, start_time);
+	m_complete_time = std::max(m_complete_time, complete_time);
 }
 
 
-JOB_ENTRY::JOB_ENTRY
-(
-	JOB_NAME && name, PRIORITY pri, size_t num_subtasks,
-	TIME earliest_start_time, TIME subtask_duration
-) :
-	m_name(std::move(name)), m_priority(pri), m_num_subtasks(num_subtasks),
-	m_earliest_start_time(earliest_start_time), m_subtask_duration(subtask_duration)
-{
-	assert(num_subtasks > 0);
-	assert(subtask_duration > 0);
-}
-
-void JOB_ENTRY::set_idx(JOB_IDX idx)
-{
-	assert(!m_id_set);
-	m_status.set_parent(idx);
-	m_idx = idx;
-	m_id_set = true;
-}
+constexpr NAME_ARENA::NAME_ID NAME_ARENA::NIL;
 
-const JOB_NAME & JOB_ENTRY::get_name() const
+// FNV-1a
+size_t NAME_ARENA::hash(const char * name, size_t length) const
 {
-	return m_name;
-}
-
-const JOB_STATUS & JOB_ENTRY::get_status() const
-{
-	return m_status;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= uint8_t(name[i]);
+		hash *= 16777619u;
+	}
+	return hash;
 }
 
-JOB_STATUS & JOB_ENTRY::get_modifiable_status()
+NAME_ARENA::NAME_ID NAME_ARENA::intern(const char * name, size_t length)
 {
-	return m_status;
-}
+	// Keep the lookup table at most half full
+	if (2 * (m_names.size() + 1) > m_lookup.size())
+	{
+		grow_lookup();
+	}
 
-PRIORITY JOB_ENTRY::get_priority() const
-{
-	return m_priority;
-}
+	size_t mask = m_lookup.size() - 1;
+	size_t slot = hash(name, length) & mask;
+	while (m_lookup[slot] != NIL)
+	{
+		NAME_ID id = m_lookup[slot];
+		if (get_length(id) == length && std::memcmp(get_data(id), name, length) == 0)
+		{
+			return id;
+		}
+		slot = (slot + 1) & mask;
+	}
 
-size_t JOB_ENTRY::get_num_subtasks() const
-{
-	return m_num_subtasks;
+	assert(m_chars.size() + length <= UINT32_MAX);
+	assert(m_names.size() < NIL);
+	NAME_ID id = NAME_ID(m_names.size());
+	m_names.push_back(NAME{uint32_t(m_chars.size()), uint32_t(length)});
+	m_chars.insert(m_chars.end(), name, name + length);
+	m_lookup[slot] = id;
+	return id;
 }
 
-TIME JOB_ENTRY::get_earliest_start_time() const
+void NAME_ARENA::grow_lookup()
 {
-	return m_earliest_start_time;
+	std::vector<NAME_ID> lookup(std::max<size_t>(16, 2 * m_lookup.size()), NIL);
+	size_t mask = lookup.size() - 1;
+	for (NAME_ID id = 0; id < m_names.size(); ++id)
+	{
+		size_t slot = hash(get_data(id), get_length(id)) & mask;
+		while (lookup[slot] != NIL)
+		{
+			slot = (slot + 1) & mask;
+		}
+		lookup[slot] = id;
+	}
+	m_lookup.swap(lookup);
 }
 
-TIME JOB_ENTRY::get_subtask_duration() const
+JOB_NAME JOB_ENTRY::get_name() const
 {
-	return m_subtask_duration;
+	const NAME_ARENA & arena = m_pool->m_name_arena;
+	NAME_ARENA::NAME_ID name = m_pool->m_names[m_idx];
+	return JOB_NAME(arena.get_data(name), arena.get_length(name));
 }
 
 std::string JOB_ENTRY::to_string() const
 {
 	bool submitted = get_status().submitted();
 	std::string output;
-	output += "#" + std::to_string(m_idx) + " " + m_name;
-	output += " sbtk=" + std::to_string(m_num_subtasks);
-	output += " dur=" + std::to_string(m_subtask_duration);
-	output += " erly=" + std::to_string(m_earliest_start_time);
-	output += " pri=" + std::to_string(m_priority);
+	output += "#" + std::to_string(m_idx) + " " + get_name();
+	output += " sbtk=" + std::to_string(get_num_subtasks());
+	output += " dur=" + std::to_string(get_subtask_duration());
+	output += " erly=" + std::to_string(get_earliest_start_time());
+	output += " pri=" + std::to_string(get_priority());
 	output += " sbmt=" + std::to_string(submitted);
-	output += " id_set=" + std::to_string(m_id_set);
+	output += " id_set=" + std::to_string(m_pool->m_sorted_and_indexed);
 	if (submitted)
 	{
 		output += " start=" + std::to_string(get_status().get_start_time());
@@ -211,121 +262,193 @@ std::string JOB_ENTRY::to_string() const
 
 }
 
-JOB_QUEUE::JOB_QUEUE()
+JOB_QUEUE::JOB_QUEUE(bool from_job_pool)
 {
+	if (!from_job_pool)
+	{
+		return;
+	}
 	JOB_POOL & job_pool = JOB_POOL::get_inst();
 	assert(!job_pool.empty());
 	assert(job_pool.is_ready());
-	m_jobs.assign(job_pool.begin(), job_pool.end());
+	m_jobs.clear();
+	m_jobs.reserve(job_pool.size() + 1);
+	for (JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+	{
+		m_jobs.push_back(job_idx);
+	}
+	// The pool is sorted by early cost, which is the default queue order too. Job indices don't
+	// depend on the queue order, as the schedule is written with them.
+	auto less_than = [&job_pool](JOB_IDX lhs, JOB_IDX rhs) {
+			return l_job_queue_order_less_than(job_pool[lhs], job_pool[rhs]);
+		};
+	if (!std::is_sorted(m_jobs.begin(), m_jobs.end(), less_than))
+	{
+		std::stable_sort(m_jobs.begin(), m_jobs.end(), less_than);
+	}
+	m_jobs.push_back(SENTINEL);
 }
 
 
-void JOB_QUEUE::add_job(JOB_ENTRY & job)
+void JOB_QUEUE::add_job(const JOB_ENTRY & job)
 {
-	JOB_Q_ENTRY new_entry(job);
+	JOB_Q_ENTRY new_entry(job.get_index());
+	assert(new_entry < SENTINEL);
 
-	bool debug = false;
-	if (debug) std::cout << "Queuing job " << job.get_name() << std::endl;
+	SCHED_LOG(TRACE) << "Queuing job " << job.get_name();
+	compact(); // Tombstones would get in the way of the binary search
+	JOB_POOL & job_pool = JOB_POOL::get_inst();
 	auto iter = std::upper_bound(
-		m_jobs.begin(), m_jobs.end(), new_entry,
-		[](const JOB_Q_ENTRY & lhs, const JOB_Q_ENTRY & rhs) {
-			return bool(l_job_queue_order_less_than(lhs.get(), rhs.get()));
+		m_jobs.begin(), m_jobs.end() - 1, new_entry,
+		[&job_pool](JOB_Q_ENTRY lhs, JOB_Q_ENTRY rhs) {
+			return bool(l_job_queue_order_less_than(job_pool[lhs], job_pool[rhs]));
 		});
-	m_jobs.insert(iter, std::move(new_entry));
+	m_jobs.insert(iter, new_entry);
 }
 
 
 void JOB_QUEUE::erase(JOB_QUEUE::ITER job_iter)
 {
-	m_jobs.erase(job_iter);
-}
-
-JOB_QUEUE::ITER JOB_QUEUE::begin()
-{
-	return m_jobs.begin();
-}
-
-
-JOB_QUEUE::ITER JOB_QUEUE::end()
-{
-	return m_jobs.end();
-}
+	assert(job_iter != cend());
+	size_t pos = job_iter.m_pos - m_jobs.data();
 
-JOB_QUEUE::CITER JOB_QUEUE::cbegin() const
-{
-	return m_jobs.cbegin();
-}
-
-JOB_QUEUE::CITER JOB_QUEUE::cend() const
-{
-	return m_jobs.cend();
-}
+	if (pos - m_head <= MAX_ERASE_SHIFT)
+	{
+		// Close to the head, which is where the dispatcher erases: shift the jobs before it one slot
+		// back instead, so that the scanned part of the queue stays free of tombstones.
+		std::move_backward(m_jobs.begin() + m_head, m_jobs.begin() + pos, m_jobs.begin() + pos + 1);
+		pos = m_head;
+	}
+	m_jobs[pos] = TOMBSTONE;
+	++m_num_tombstones;
+	if (pos == m_head)
+	{
+		m_head = ITER(m_jobs.data() + m_head).m_pos - m_jobs.data();
+	}
 
-bool JOB_QUEUE::empty() const
-{
-	return m_jobs.empty();
+	// Tombstones in front of the head are never scanned again. Only the ones after it cost anything.
+	if (m_num_tombstones - m_head > size())
+	{
+		compact();
+	}
 }
 
-size_t JOB_QUEUE::size() const
+void JOB_QUEUE::compact()
 {
-	return m_jobs.size();
+	if (m_num_tombstones == 0)
+	{
+		return;
+	}
+	m_jobs.erase(std::remove(m_jobs.begin(), m_jobs.end(), TOMBSTONE), m_jobs.end());
+	m_head = 0;
+	m_num_tombstones = 0;
 }
 
 void JOB_QUEUE::load()
 {
-	bool debug = true;
-
-	if (debug) std::cout << "Loading up job queue...\n";
+	SCHED_LOG(INFO) << "Loading up job queue...";
 
-	assert(m_job_queue_inst == nullptr);
+	CONTEXT::SCHED_CONTEXT & context = CONTEXT::SCHED_CONTEXT::get_current();
+	assert(!context.has_job_queue());
 	assert(!JOB_POOL::get_inst().empty());
-	m_job_queue_inst = new JOB_QUEUE;
-	assert(m_job_queue_inst != nullptr);
-	assert(!m_job_queue_inst->empty());
+	context.m_job_queue = new JOB_QUEUE(true);
+	assert(!context.m_job_queue->empty());
 
-	if (debug)
-	{
-		std::cout << "Done loading job queue! Here's the result in order:\n";
-		std::cout << *m_job_queue_inst;
-	}
+	SCHED_LOG(DEBUG) << "Done loading job queue! Here's the result in order:\n" << *context.m_job_queue;
+
+}
 
+void JOB_QUEUE::load_empty()
+{
+	CONTEXT::SCHED_CONTEXT & context = CONTEXT::SCHED_CONTEXT::get_current();
+	assert(!context.has_job_queue());
+	context.m_job_queue = new JOB_QUEUE(false);
 }
 
 JOB_QUEUE & JOB_QUEUE::get_inst()
 {
-	assert(m_job_queue_inst != nullptr);
-	return *m_job_queue_inst;
+	return CONTEXT::SCHED_CONTEXT::get_current().get_job_queue();
 }
 
 std::ostream & operator<<(std::ostream & os, const JOB_QUEUE & job_q)
 {
+	const JOB_POOL & job_pool = JOB_POOL::get_inst();
 	for (auto iter = job_q.cbegin(); iter != job_q.cend(); ++iter)
 	{
-		os << iter->get().to_string() << std::endl;
+		os << job_pool[*iter].to_string() << std::endl;
 	}
 	return os;
 }
 
-void JOB_POOL::add_job(JOB_ENTRY && job)
+JOB_IDX JOB_POOL::push_job
+(
+	const char * name, size_t name_length, PRIORITY pri, size_t num_subtasks,
+	TIME earliest_start_time, TIME subtask_duration
+)
+{
+	assert(num_subtasks > 0);
+	assert(subtask_duration > 0);
+	assert(size() < UINT32_MAX);
+	m_names.push_back(m_name_arena.intern(name, name_length));
+	m_priorities.push_back(pri);
+	m_num_subtasks.push_back(num_subtasks);
+	m_earliest_start_times.push_back(earliest_start_time);
+	m_subtask_durations.push_back(subtask_duration);
+	m_statuses.emplace_back();
+	return JOB_IDX(size() - 1);
+}
+
+void JOB_POOL::add_job
+(
+	const char * name, size_t name_length, PRIORITY pri, size_t num_subtasks,
+	TIME earliest_start_time, TIME subtask_duration
+)
 {
 	assert(!m_sorted_and_indexed);
-	bool debug = true;
-	if (debug) std::cout << "Parsed job from input: " << job.get_name() << std::endl;
-	m_jobs.push_back(std::move(job));
+	JOB_IDX job_idx = push_job(name, name_length, pri, num_subtasks, earliest_start_time, subtask_duration);
+	SCHED_LOG(DEBUG) << "Parsed job from input: " << (*this)[job_idx].get_name();
+}
+
+JOB_ENTRY JOB_POOL::add_indexed_job
+(
+	const char * name, size_t name_length, PRIORITY pri, size_t num_subtasks,
+	TIME earliest_start_time, TIME subtask_duration
+)
+{
+	assert(m_sorted_and_indexed || empty());
+	JOB_IDX job_idx = push_job(name, name_length, pri, num_subtasks, earliest_start_time, subtask_duration);
+	m_statuses[job_idx].set_parent(job_idx);
+	m_sorted_and_indexed = true;
+	SCHED_LOG(DEBUG) << "Admitted job from input: " << (*this)[job_idx].get_name();
+	return (*this)[job_idx];
 }
 
 void JOB_POOL::sort_and_create_index()
 {
-	std::sort(m_jobs.begin(), m_jobs.end(), l_job_queue_order_less_than);
+	// Sort job indices, then move every column into that order
+	std::vector<JOB_IDX> order(size());
+	for (JOB_IDX job_idx = 0; job_idx < order.size(); ++job_idx)
+	{
+		order[job_idx] = job_idx;
+	}
+	std::sort(order.begin(), order.end(),
+		[this](JOB_IDX lhs, JOB_IDX rhs) {
+			return l_job_early_cost_less_than((*this)[lhs], (*this)[rhs]);
+		});
+	l_permute(m_names, order);
+	l_permute(m_priorities, order);
+	l_permute(m_num_subtasks, order);
+	l_permute(m_earliest_start_times, order);
+	l_permute(m_subtask_durations, order);
 	re_index();
 	m_sorted_and_indexed = true;
 }
 
 void JOB_POOL::re_index()
 {
-	for (size_t i = 0; i < m_jobs.size(); ++i)
+	for (JOB_IDX job_idx = 0; job_idx < size(); ++job_idx)
 	{
-		m_jobs[i].set_idx(i);
+		m_statuses[job_idx].set_parent(job_idx);
 	}
 }
 
@@ -336,48 +459,24 @@ bool JOB_POOL::is_ready() const
 
 bool JOB_POOL::empty() const
 {
-	return m_jobs.empty();
+	return m_names.empty();
 }
 
 size_t JOB_POOL::size() const
 {
-	return m_jobs.size();
-}
-
-JOB_POOL::CITER JOB_POOL::cbegin() const
-{
-	return m_jobs.cbegin();
-}
-
-JOB_POOL::CITER JOB_POOL::cend() const
-{
-	return m_jobs.cend();
-}
-
-JOB_POOL::ITER JOB_POOL::begin()
-{
-	return m_jobs.begin();
-}
-
-JOB_POOL::ITER JOB_POOL::end()
-{
-	return m_jobs.end();
+	return m_names.size();
 }
 
 JOB_POOL & JOB_POOL::get_inst()
 {
-	if (m_instance == nullptr)
-	{
-		m_instance = new JOB_POOL;
-	}
-	return *m_instance;
+	return CONTEXT::SCHED_CONTEXT::get_current().get_job_pool();
 }
 
 std::ostream & operator<<(std::ostream & os, const JOB_POOL & jobs)
 {
-	for (auto iter = jobs.cbegin(); iter != jobs.cend(); ++iter)
+	for (JOB_IDX job_idx = 0; job_idx < jobs.size(); ++job_idx)
 	{
-		os << iter->to_string() << std::endl;
+		os << jobs[job_idx].to_string() << std::endl;
 	}
 	return os;
 }
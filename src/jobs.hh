@@ -4,33 +4,35 @@
 
 #include <string>
 #include <cstring>
+#include <cstdint>
+#include <cassert>
 #include <vector>
-#include <list>
 #include <functional>
+#include <iterator>
+#include <cstddef>
 
-namespace WORKERS
+namespace CONTEXT
 {
-class SUBTASK;
+class SCHED_CONTEXT;
 }
 
-
 namespace JOBS
 {
 
 typedef std::string JOB_NAME;
 typedef size_t PRIORITY;
 typedef size_t TIME;
-typedef size_t JOB_IDX;
+typedef uint32_t JOB_IDX;
 
 class JOB_ENTRY;
+class JOB_POOL;
 
 namespace COST_CALC
 {
 
-typedef float COST;
-
-COST get_cost_for_job(const JOB_ENTRY & job);
+typedef double COST; // Same as COST_ENGINE sums in
 
+// Evaluates COST_ENGINE from scratch, and logs it. Every job must be submitted.
 COST get_total_cost();
 
 }
@@ -48,7 +50,7 @@ public:
 
 	//JOB_STATUS();
 
-	const JOB_ENTRY & get_job() const;
+	JOB_ENTRY get_job() const;
 
 	bool submitted() const;
 	bool is_clean() const;
@@ -58,44 +60,84 @@ public:
 
 	void set_parent(JOB_IDX idx);
 	void reset();
-	void add_subtask(const WORKERS::SUBTASK & subtask);
+	void add_subtask(TIME start_time, TIME complete_time);
 
 	std::string to_string() const
 	{
 		return
 			std::to_string(m_job_idx) + " " +
-			std::to_string(m_subtasks.size()) + " " +
+			std::to_string(m_num_subtasks) + " " +
 			std::to_string(m_start_time) + " " +
 			std::to_string(m_complete_time);
 	}
 
 private:
-	std::vector<std::reference_wrapper<const WORKERS::SUBTASK>> m_subtasks;
+	// Subtasks themselves live in the workers' execution history. Projected statuses don't have any.
 	TIME m_start_time;
 	TIME m_complete_time;
+	size_t m_num_subtasks = 0;
 	JOB_IDX m_job_idx = 0;
 	bool parent_set = false;
 };
 
 
+// Job names, packed back to back in one buffer. Equal names are stored once.
+class NAME_ARENA
+{
+public:
+	typedef uint32_t NAME_ID;
+
+	NAME_ARENA() = default;
+	NAME_ARENA(const NAME_ARENA &) = delete;
+	NAME_ARENA(NAME_ARENA &&) = delete;
+	NAME_ARENA & operator=(const NAME_ARENA &) = delete;
+	NAME_ARENA & operator=(NAME_ARENA &&) = delete;
+	~NAME_ARENA() = default;
+
+	// Getters
+	const char * get_data(NAME_ID id) const { return m_chars.data() + m_names[id].offset; }
+	size_t get_length(NAME_ID id) const { return m_names[id].length; }
+	size_t size() const { return m_names.size(); }
+
+	// Modifiers
+	NAME_ID intern(const char * name, size_t length);
+
+private:
+	struct NAME
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	static constexpr NAME_ID NIL = UINT32_MAX;
+
+	size_t hash(const char * name, size_t length) const;
+	void grow_lookup();
+
+	std::vector<char> m_chars;
+	std::vector<NAME> m_names;
+	std::vector<NAME_ID> m_lookup; // Open addressing, linear probing. Size is a power of two.
+};
+
+
+// One job of JOB_POOL. The job itself is spread over the pool's columns; this is only the pool and
+// the job's index, so it's cheap to pass around by value.
 class JOB_ENTRY
 {
 public:
 
 	JOB_ENTRY() = delete;
-	JOB_ENTRY(const JOB_ENTRY &) = delete;
+	JOB_ENTRY(const JOB_ENTRY &) = default;
 	JOB_ENTRY(JOB_ENTRY &&) = default;
-	JOB_ENTRY & operator=(const JOB_ENTRY &) = delete;
+	JOB_ENTRY & operator=(const JOB_ENTRY &) = default;
 	JOB_ENTRY & operator=(JOB_ENTRY &&) = default;
 	~JOB_ENTRY() = default;
 
-	JOB_ENTRY(JOB_NAME && name, PRIORITY pri, size_t num_subtasks,
-		TIME earliest_start_time, TIME subtask_duration);
-	void set_idx(JOB_IDX idx);
+	JOB_ENTRY(JOB_POOL & pool, JOB_IDX idx) : m_pool(&pool), m_idx(idx) {}
 
 	const JOB_STATUS & get_status() const;
 	JOB_STATUS & get_modifiable_status();
-	const JOB_NAME & get_name() const;
+	JOB_NAME get_name() const;
 	PRIORITY get_priority() const;
 	size_t get_num_subtasks() const;
 	TIME get_earliest_start_time() const;
@@ -105,103 +147,174 @@ public:
 	std::string to_string() const;
 
 private:
-	JOB_STATUS m_status;
-	JOB_NAME m_name;
-	PRIORITY m_priority;
-	size_t m_num_subtasks;
-	TIME m_earliest_start_time;
-	TIME m_subtask_duration;
-	JOB_IDX m_idx = 0;
-	bool m_id_set = false;
+	JOB_POOL * m_pool;
+	JOB_IDX m_idx;
 };
 
 
+// Job indices in queue order, in one flat array. Erasing a job near the head shifts the jobs before
+// it. Further in, the job is left behind as a tombstone that iterators skip, and tombstones are swept
+// out once they outnumber the queued jobs. Erasing or adding a job invalidates iterators.
 class JOB_QUEUE
 {
 private:
-	typedef std::reference_wrapper<JOB_ENTRY> JOB_Q_ENTRY;
-	typedef std::list<JOB_Q_ENTRY> CONTAINER;
+	typedef JOB_IDX JOB_Q_ENTRY;
+	typedef std::vector<JOB_Q_ENTRY> CONTAINER;
+	static constexpr JOB_Q_ENTRY TOMBSTONE = UINT32_MAX;
+	static constexpr JOB_Q_ENTRY SENTINEL = UINT32_MAX - 1; // Always the last entry. end() points to it.
+	static constexpr size_t MAX_ERASE_SHIFT = 256;
 public:
-	typedef CONTAINER::iterator ITER;
-	typedef CONTAINER::const_iterator CITER;
+	// Dereferences to the job index
+	class CITER
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef JOB_IDX value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const JOB_IDX * pointer;
+		typedef JOB_IDX reference;
+
+		CITER() = default;
+
+		JOB_IDX operator*() const { return *m_pos; }
+		CITER & operator++() { ++m_pos; skip_tombstones(); return *this; }
+		bool operator==(const CITER & other) const { return m_pos == other.m_pos; }
+		bool operator!=(const CITER & other) const { return m_pos != other.m_pos; }
+
+	private:
+		friend class JOB_QUEUE;
+
+		explicit CITER(const JOB_Q_ENTRY * pos) : m_pos(pos) { skip_tombstones(); }
+		void skip_tombstones() { while (*m_pos == TOMBSTONE) { ++m_pos; } } // The sentinel stops it
+
+		const JOB_Q_ENTRY * m_pos = nullptr;
+	};
+	typedef CITER ITER; // Entries can't be modified in place
 
 	JOB_QUEUE & operator=(const JOB_QUEUE &) = delete;
 	JOB_QUEUE & operator=(JOB_QUEUE &&) = delete;
 
 	void erase(ITER job_iter);
+	void add_job(const JOB_ENTRY & job);
 
-	ITER begin();
-	ITER end();
+	// Inline, since the dispatcher checks against end() on every step of its scan
+	ITER begin() { return cbegin(); }
+	ITER end() { return cend(); }
 
-	CITER cbegin() const;
-	CITER cend() const;
+	CITER cbegin() const { return CITER(m_jobs.data() + m_head); }
+	CITER cend() const { return CITER(m_jobs.data() + m_jobs.size() - 1); }
 
-	bool empty() const;
-	size_t size() const;
+	bool empty() const { return size() == 0; }
+	size_t size() const { return m_jobs.size() - 1 - m_num_tombstones; }
 
 	friend std::ostream & operator<<(std::ostream & os, const JOB_QUEUE & job_q);
 
+	// Into the current context, once per context
 	static void load();
+	static void load_empty(); // Streaming mode: jobs get added as they arrive
 	static JOB_QUEUE & get_inst();
 
 private:
-	JOB_QUEUE();
+	friend class CONTEXT::SCHED_CONTEXT;
+
+	explicit JOB_QUEUE(bool from_job_pool);
 	JOB_QUEUE(const JOB_QUEUE &) = delete;
 	JOB_QUEUE(JOB_QUEUE &&) = delete;
 	~JOB_QUEUE() = default;
 
-	void add_job(JOB_ENTRY & job);
-
-	CONTAINER m_jobs;
+	void compact();
 
-	static JOB_QUEUE * m_job_queue_inst;
+	CONTAINER m_jobs{SENTINEL};
+	size_t m_head = 0; // Everything before it is a tombstone
+	size_t m_num_tombstones = 0;
 };
 
+// Every job, stored column by column: a pass over one field of all the jobs (queue ordering, cost)
+// walks through contiguous memory. Subtasks, the job queue and the projection cache refer to jobs by
+// index, so admitting jobs in streaming mode may move the columns.
 class JOB_POOL
 {
-private:
-	typedef std::vector<JOB_ENTRY> CONTAINER;
-	typedef CONTAINER::iterator ITER;
 public:
-	typedef CONTAINER::const_iterator CITER;
-
 	JOB_POOL & operator=(const JOB_POOL &) = delete;
 	JOB_POOL & operator=(JOB_POOL &&) = delete;
 
 	// Modifiers
-	void add_job(JOB_ENTRY && job);
+	void add_job(const char * name, size_t name_length, PRIORITY pri, size_t num_subtasks,
+		TIME earliest_start_time, TIME subtask_duration);
 	void sort_and_create_index();
+	// Streaming mode: no sorting, index on arrival
+	JOB_ENTRY add_indexed_job(const char * name, size_t name_length, PRIORITY pri, size_t num_subtasks,
+		TIME earliest_start_time, TIME subtask_duration);
 
 	// Accessors
 	bool empty() const;
 	size_t size() const;
 	bool is_ready() const;
 
-	ITER begin();
-	ITER end();
-	CITER cbegin() const;
-	CITER cend() const;
-
-	JOB_ENTRY & operator[](size_t idx) { return m_jobs[idx]; }
+	JOB_ENTRY operator[](JOB_IDX idx) { assert(idx < size()); return JOB_ENTRY(*this, idx); }
+	// Read-only handle
+	const JOB_ENTRY operator[](JOB_IDX idx) const { return const_cast<JOB_POOL &>(*this)[idx]; }
 
 	friend std::ostream & operator<<(std::ostream & os, const JOB_POOL & job_q);
 
 	static JOB_POOL & get_inst();
 
 private:
+	friend class JOB_ENTRY;
+	friend class CONTEXT::SCHED_CONTEXT;
+
 	JOB_POOL() = default;
 	JOB_POOL(const JOB_POOL &) = delete;
 	JOB_POOL(JOB_POOL &&) = delete;
 	~JOB_POOL() = default;
 
+	JOB_IDX push_job(const char * name, size_t name_length, PRIORITY pri, size_t num_subtasks,
+		TIME earliest_start_time, TIME subtask_duration);
 	void re_index();
 
-	CONTAINER m_jobs;
-	bool m_sorted_and_indexed = false;
+	NAME_ARENA m_name_arena;
+
+	// Columns, indexed by job index
+	std::vector<NAME_ARENA::NAME_ID> m_names;
+	std::vector<PRIORITY> m_priorities;
+	std::vector<size_t> m_num_subtasks;
+	std::vector<TIME> m_earliest_start_times;
+	std::vector<TIME> m_subtask_durations;
+	std::vector<JOB_STATUS> m_statuses;
 
-	static JOB_POOL * m_instance;
+	bool m_sorted_and_indexed = false;
 };
 
+inline const JOB_STATUS & JOB_ENTRY::get_status() const
+{
+	return m_pool->m_statuses[m_idx];
+}
+
+inline JOB_STATUS & JOB_ENTRY::get_modifiable_status()
+{
+	return m_pool->m_statuses[m_idx];
+}
+
+inline PRIORITY JOB_ENTRY::get_priority() const
+{
+	return m_pool->m_priorities[m_idx];
+}
+
+inline size_t JOB_ENTRY::get_num_subtasks() const
+{
+	return m_pool->m_num_subtasks[m_idx];
+}
+
+inline TIME JOB_ENTRY::get_earliest_start_time() const
+{
+	return m_pool->m_earliest_start_times[m_idx];
+}
+
+inline TIME JOB_ENTRY::get_subtask_duration() const
+{
+	return m_pool->m_subtask_durations[m_idx];
+}
+
 std::ostream & operator<<(std::ostream & os, const JOB_QUEUE & job_q);
 std::ostream & operator<<(std::ostream & os, const JOB_POOL & job_q);
 
@@ -0,0 +1,204 @@
+#include "local_search.hh"
+#include "jobs.hh"
+#include "workers.hh"
+#include "cost_engine.hh"
+#include "log.hh"
+#include "stats.hh"
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+
+namespace LOCAL_SEARCH
+{
+
+namespace
+{
+
+typedef std::chrono::steady_clock CLOCK_TYPE;
+typedef WORKERS::WORKER_MGR::PLACEMENTS PLACEMENTS;
+
+const size_t MAX_JOBS_PER_MOVE = 4;
+// In start order, from the latest job of a move to the others
+const size_t MAX_PARTNER_DISTANCE = 32;
+const size_t MOVES_PER_REORDER = 4096;
+
+// What the search knows about the schedule, kept in step with the workers. The costs are kept by
+// JOBS::COST_CALC::COST_ENGINE, which WORKER_MGR updates as jobs go in and out.
+struct SEARCH_STATE
+{
+	std::vector<PLACEMENTS> placements; // By job index
+	std::vector<JOBS::JOB_IDX> start_order; // Job indices by start time, as of the last reorder
+
+	PLACEMENTS saved[MAX_JOBS_PER_MOVE]; // Where the jobs of the current move were before it
+};
+
+// Placements come from the worker histories, as the dispatcher doesn't keep them.
+void l_init(SEARCH_STATE & state)
+{
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	const WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	state.placements.assign(job_pool.size(), PLACEMENTS());
+	for (JOBS::JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+	{
+		state.placements[job_idx].reserve(job_pool[job_idx].get_num_subtasks());
+	}
+	for (auto worker_iter = worker_mgr.cbegin(); worker_iter != worker_mgr.cend(); ++worker_iter)
+	{
+		for (auto run_iter = worker_iter->get_history().cbegin(); run_iter != worker_iter->get_history().cend(); ++run_iter)
+		{
+			const JOBS::TIME duration = run_iter->get_job().get_subtask_duration();
+			PLACEMENTS & placements = state.placements[run_iter->get_job_index()];
+			for (size_t i = 0; i < run_iter->get_num_subtasks(); ++i)
+			{
+				placements.push_back(WORKERS::WORKER_MGR::PLACEMENT{
+					worker_iter->get_index(), run_iter->get_start_time() + i * duration, run_iter});
+			}
+		}
+	}
+
+	state.start_order.resize(job_pool.size());
+	for (JOBS::JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+	{
+		state.start_order[job_idx] = job_idx;
+	}
+}
+
+void l_reorder(SEARCH_STATE & state)
+{
+	const JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	std::sort(state.start_order.begin(), state.start_order.end(),
+		[&job_pool](JOBS::JOB_IDX lhs, JOBS::JOB_IDX rhs)
+		{
+			JOBS::TIME lhs_start = job_pool[lhs].get_status().get_start_time();
+			JOBS::TIME rhs_start = job_pool[rhs].get_status().get_start_time();
+			return (lhs_start != rhs_start) ? lhs_start < rhs_start : lhs < rhs;
+		});
+}
+
+// Takes the jobs out, then dispatches them again in the given order. Only their own costs can
+// change, so that's all that's compared. Puts them back where they were unless the cost went
+// down. Returns whether the move was kept.
+bool l_try_move(SEARCH_STATE & state, const JOBS::JOB_IDX * job_indices, size_t num_jobs)
+{
+	assert(num_jobs <= MAX_JOBS_PER_MOVE);
+	JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+	WORKERS::WORKER_MGR & worker_mgr = WORKERS::WORKER_MGR::get_inst();
+	const JOBS::COST_CALC::COST_ENGINE & cost_engine = JOBS::COST_CALC::COST_ENGINE::get_inst();
+
+	double old_cost = 0;
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		JOBS::JOB_ENTRY job = job_pool[job_indices[i]];
+		old_cost += cost_engine.get_job_cost(job_indices[i]);
+		state.saved[i].swap(state.placements[job_indices[i]]);
+		worker_mgr.remove_job(job, job.get_modifiable_status(), state.saved[i]);
+	}
+	double new_cost = 0;
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		JOBS::JOB_ENTRY job = job_pool[job_indices[i]];
+		state.placements[job_indices[i]].clear();
+		worker_mgr.submit_job(job, job.get_modifiable_status(), &state.placements[job_indices[i]]);
+		new_cost += cost_engine.get_job_cost(job_indices[i]);
+	}
+
+	if (new_cost < old_cost)
+	{
+		return true;
+	}
+
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		JOBS::JOB_ENTRY job = job_pool[job_indices[i]];
+		worker_mgr.remove_job(job, job.get_modifiable_status(), state.placements[job_indices[i]]);
+	}
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		JOBS::JOB_ENTRY job = job_pool[job_indices[i]];
+		worker_mgr.restore_job(job, job.get_modifiable_status(), state.saved[i]);
+		state.placements[job_indices[i]].swap(state.saved[i]);
+	}
+	return false;
+}
+
+} // End anonymous namespace
+
+// A move takes a job and up to MAX_JOBS_PER_MOVE - 1 that started a little before it, and dispatches
+// the later one first: the same as moving it ahead of them in the dispatch order, without touching
+// the jobs in between. The others follow in random order. The jobs are drawn from a generator with
+// a fixed seed, so a run capped by moves alone always ends with the same schedule.
+//
+// A move takes at least tens of microseconds, so reading the clock before each one is free, and
+// keeps a tight time limit tight.
+void improve(float max_seconds, size_t max_num_moves)
+{
+	if (max_num_moves == 0)
+	{
+		max_num_moves = std::numeric_limits<size_t>::max();
+	}
+	const CLOCK_TYPE::time_point start = CLOCK_TYPE::now();
+
+	SEARCH_STATE state;
+	l_init(state);
+	const size_t num_jobs = state.start_order.size();
+	const JOBS::COST_CALC::COST_ENGINE & cost_engine = JOBS::COST_CALC::COST_ENGINE::get_inst();
+	const double initial_cost = cost_engine.get_total_cost();
+	if (num_jobs < 2)
+	{
+		return;
+	}
+	l_reorder(state);
+	SCHED_LOG(INFO) << "Improving the schedule, from cost " << initial_cost << "...";
+
+	std::mt19937 rng(1);
+	size_t num_moves = 0;
+	size_t num_accepted = 0;
+	bool reorder_needed = false;
+	while (num_moves < max_num_moves)
+	{
+		if (max_seconds > 0 &&
+			std::chrono::duration<float>(CLOCK_TYPE::now() - start).count() >= max_seconds)
+		{
+			break;
+		}
+		if (num_moves % MOVES_PER_REORDER == 0 && reorder_needed)
+		{
+			l_reorder(state);
+			reorder_needed = false;
+		}
+
+		size_t position = 1 + rng() % (num_jobs - 1);
+		JOBS::JOB_IDX job_indices[MAX_JOBS_PER_MOVE] = {state.start_order[position]};
+		size_t num_moved = 1 + rng() % MAX_JOBS_PER_MOVE;
+		size_t window = std::min(MAX_PARTNER_DISTANCE, position);
+		num_moved = std::min(num_moved, window + 1);
+		for (size_t i = 1; i < num_moved; ++i)
+		{
+			JOBS::JOB_IDX partner;
+			do
+			{
+				partner = state.start_order[position - 1 - rng() % window];
+			} while (std::find(job_indices, job_indices + i, partner) != job_indices + i);
+			job_indices[i] = partner;
+		}
+		if (l_try_move(state, job_indices, num_moved))
+		{
+			++num_accepted;
+			reorder_needed = true;
+		}
+		++num_moves;
+	}
+
+	SCHED_STAT_ADD(IMPROVE_MOVES_TRIED, num_moves);
+	SCHED_STAT_ADD(IMPROVE_MOVES_ACCEPTED, num_accepted);
+	float seconds = std::chrono::duration<float>(CLOCK_TYPE::now() - start).count();
+	SCHED_LOG(INFO) << "Local search: kept " << num_accepted << " of " << num_moves << " moves in " << seconds
+		<< "s (" << (seconds > 0 ? num_moves / seconds : 0.0f) << " moves/s), cost " << initial_cost
+		<< " -> " << cost_engine.get_total_cost();
+}
+
+} // End namespace LOCAL_SEARCH
@@ -0,0 +1,17 @@
+#ifndef LOCAL_SEARCH_HH
+#define LOCAL_SEARCH_HH
+
+#include <cstddef>
+
+namespace LOCAL_SEARCH
+{
+
+// Improves the schedule the dispatcher left in the workers of the current context, for up to
+// max_seconds and max_num_moves moves, either of which may be 0 for no limit. Each move takes up to
+// four jobs out and dispatches them again, and is kept only if it lowers the total cost. Every other
+// job stays where it is, so the schedule is legal after every move.
+void improve(float max_seconds, size_t max_num_moves);
+
+} // End namespace LOCAL_SEARCH
+
+#endif
@@ -0,0 +1,38 @@
+
+#include "log.hh"
+
+#include <iostream>
+#include <mutex>
+
+namespace LOG
+{
+
+LEVEL LOGGER::m_level = LEVEL::INFO;
+
+namespace
+{
+
+std::mutex l_output_mutex;
+
+}
+
+bool LOGGER::parse_level(const std::string & name, LEVEL & level)
+{
+	if (name == "none") { level = LEVEL::NONE; }
+	else if (name == "error") { level = LEVEL::ERROR; }
+	else if (name == "warning") { level = LEVEL::WARNING; }
+	else if (name == "info") { level = LEVEL::INFO; }
+	else if (name == "debug") { level = LEVEL::DEBUG; }
+	else if (name == "trace") { level = LEVEL::TRACE; }
+	else { return false; }
+	return true;
+}
+
+LINE::~LINE()
+{
+	m_stream << '\n';
+	std::lock_guard<std::mutex> lock(l_output_mutex);
+	std::cerr << m_stream.str();
+}
+
+} // End namespace LOG
@@ -0,0 +1,65 @@
+#ifndef LOG_HH
+#define LOG_HH
+
+#include <sstream>
+#include <string>
+
+// Log sites above this level are compiled out entirely. Set with "make LOG_LEVEL=<n>".
+#ifndef SCHED_LOG_COMPILE_LEVEL
+#define SCHED_LOG_COMPILE_LEVEL 4
+#endif
+
+namespace LOG
+{
+
+enum class LEVEL : int
+{
+	NONE = 0,
+	ERROR = 1,
+	WARNING = 2,
+	INFO = 3,    // A handful of lines per run
+	DEBUG = 4,   // Per job, per worker and per dispatch
+	TRACE = 5    // Per projection
+};
+
+class LOGGER
+{
+public:
+	static bool is_enabled(LEVEL level)
+	{
+		return int(level) <= SCHED_LOG_COMPILE_LEVEL && int(level) <= int(m_level);
+	}
+	static void set_level(LEVEL level) { m_level = level; }
+	static LEVEL get_level() { return m_level; }
+	static bool parse_level(const std::string & name, LEVEL & level);
+
+private:
+	static LEVEL m_level;
+};
+
+// One log line. It's written to stderr in one go when the line is destroyed, so lines from different
+// threads don't interleave. Stdout is left to the schedule.
+class LINE
+{
+public:
+	LINE() = default;
+	LINE(const LINE &) = delete;
+	LINE(LINE &&) = delete;
+	LINE & operator=(const LINE &) = delete;
+	LINE & operator=(LINE &&) = delete;
+	~LINE();
+
+	std::ostream & stream() { return m_stream; }
+
+private:
+	std::ostringstream m_stream;
+};
+
+} // End namespace LOG
+
+// Usage: SCHED_LOG(DEBUG) << "Dispatched job " << job.to_string();
+// Nothing right of the macro is evaluated unless the level is on.
+#define SCHED_LOG(level) \
+	if (!LOG::LOGGER::is_enabled(LOG::LEVEL::level)) {} else LOG::LINE().stream()
+
+#endif
@@ -0,0 +1,104 @@
+#include "io.hh"
+#include "jobs.hh"
+#include "dispatcher.hh"
+#include "portfolio.hh"
+#include "batch.hh"
+#include "options.hh"
+#include "log.hh"
+#include "trace.hh"
+#include "stats.hh"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+
+class FUNC_TIMER
+{
+public:
+	typedef std::chrono::steady_clock CLOCK_TYPE;
+	FUNC_TIMER()
+	: m_start(CLOCK_TYPE::now())
+	{
+
+	}
+	~FUNC_TIMER()
+	{
+		CLOCK_TYPE::duration duration = CLOCK_TYPE::now() - m_start;
+		SCHED_LOG(INFO) << "FUNC_TIMER: " << std::chrono::duration_cast<std::chrono::duration<float>>(duration).count() << "s";
+	}
+	FUNC_TIMER(const FUNC_TIMER &) = delete;
+	FUNC_TIMER(FUNC_TIMER &&) = delete;
+	FUNC_TIMER & operator=(const FUNC_TIMER &) = delete;
+	FUNC_TIMER & operator=(FUNC_TIMER &&) = delete;
+private:
+	CLOCK_TYPE::time_point m_start;
+};
+
+int main(int argc, char ** argv)
+{
+	const OPTIONS::OPTION_MGR & options = OPTIONS::OPTION_MGR::get_inst();
+	OPTIONS::OPTION_MGR::get_inst().parse(argc, argv);
+	if (SCHED_TRACE_ENABLED && !options.get_trace_path().empty())
+	{
+		TRACE::TRACE_RING::enable(options.get_trace_capacity());
+	}
+	if (SCHED_STATS_ENABLED && !options.get_stats_path().empty())
+	{
+		STATS::STATS_MGR::enable();
+	}
+
+	FUNC_TIMER timer;
+	bool all_solved = true;
+	if (!options.get_batch_list_path().empty())
+	{
+		all_solved = BATCH::solve();
+	}
+	else if (options.is_streaming())
+	{
+		IO::stream_from_stdin();
+		DISPATCHER::dispatch_all();
+		JOBS::COST_CALC::get_total_cost();
+	}
+	else if (options.get_portfolio_size() > 0)
+	{
+		IO::load_from_stdin();
+		PORTFOLIO::solve();
+	}
+	else
+	{
+		IO::load_from_stdin();
+		JOBS::JOB_QUEUE::load();
+		DISPATCHER::dispatch_all();
+		JOBS::COST_CALC::get_total_cost();
+	}
+
+	if (TRACE::TRACE_RING::is_enabled())
+	{
+		std::ofstream trace_file(options.get_trace_path());
+		if (!trace_file)
+		{
+			std::cerr << "Error: Can't open " << options.get_trace_path() << " for writing\n";
+			return 1;
+		}
+		TRACE::TRACE_RING::dump(trace_file);
+	}
+	if (STATS::STATS_MGR::is_enabled())
+	{
+		STATS::FORMAT format = options.get_stats_as_json() ? STATS::FORMAT::JSON : STATS::FORMAT::TABLE;
+		if (options.get_stats_path() == "-")
+		{
+			STATS::STATS_MGR::dump(std::cout, format);
+		}
+		else
+		{
+			std::ofstream stats_file(options.get_stats_path());
+			if (!stats_file)
+			{
+				std::cerr << "Error: Can't open " << options.get_stats_path() << " for writing\n";
+				return 1;
+			}
+			STATS::STATS_MGR::dump(stats_file, format);
+		}
+	}
+	return all_solved ? 0 : 1;
+}
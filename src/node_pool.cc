@@ -0,0 +1,50 @@
+
+#include "node_pool.hh"
+
+#include <algorithm>
+
+namespace WORKERS
+{
+
+constexpr size_t NODE_POOL::NODES_PER_SLAB;
+
+void * NODE_POOL::allocate(size_t node_size)
+{
+	if (m_node_size == 0)
+	{
+		// Round up so that every node in a slab stays aligned, and has room for the free list link.
+		const size_t align = alignof(FREE_NODE);
+		m_node_size = (std::max(node_size, sizeof(FREE_NODE)) + align - 1) / align * align;
+	}
+	assert(node_size <= m_node_size);
+
+	++m_num_node_allocations;
+	++m_num_live_nodes;
+
+	if (m_free_list != nullptr)
+	{
+		FREE_NODE * node = m_free_list;
+		m_free_list = node->next;
+		return node;
+	}
+
+	if (m_num_unused_in_slab == 0)
+	{
+		m_slabs.emplace_back(new char[m_node_size * NODES_PER_SLAB]);
+		m_num_unused_in_slab = NODES_PER_SLAB;
+	}
+	char * node = m_slabs.back().get() + m_node_size * (NODES_PER_SLAB - m_num_unused_in_slab);
+	--m_num_unused_in_slab;
+	return node;
+}
+
+void NODE_POOL::deallocate(void * node)
+{
+	assert(m_num_live_nodes > 0);
+	--m_num_live_nodes;
+	FREE_NODE * free_node = static_cast<FREE_NODE *>(node);
+	free_node->next = m_free_list;
+	m_free_list = free_node;
+}
+
+} // End namespace WORKERS
@@ -0,0 +1,98 @@
+#ifndef NODE_POOL_HH
+#define NODE_POOL_HH
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cassert>
+
+namespace WORKERS
+{
+
+// Hands out fixed-size nodes carved from large slabs. Freed nodes go on a free list and are handed
+// out again first, so once the slabs are big enough, allocating a node never reaches the heap.
+//
+// All nodes have the size of the first one allocated. Not thread safe.
+class NODE_POOL
+{
+public:
+	static constexpr size_t NODES_PER_SLAB = 1024;
+
+	NODE_POOL() = default;
+	NODE_POOL(const NODE_POOL &) = delete;
+	NODE_POOL(NODE_POOL &&) = delete;
+	NODE_POOL & operator=(const NODE_POOL &) = delete;
+	NODE_POOL & operator=(NODE_POOL &&) = delete;
+	~NODE_POOL() = default;
+
+	// Getters
+	size_t get_num_node_allocations() const { return m_num_node_allocations; }
+	size_t get_num_slab_allocations() const { return m_slabs.size(); } // The only heap allocations
+	size_t get_num_live_nodes() const { return m_num_live_nodes; }
+
+	// Modifiers
+	void * allocate(size_t node_size);
+	void deallocate(void * node);
+
+private:
+	union FREE_NODE
+	{
+		FREE_NODE * next;
+		std::max_align_t align;
+	};
+
+	std::vector<std::unique_ptr<char[]>> m_slabs;
+	FREE_NODE * m_free_list = nullptr;
+	size_t m_node_size = 0;
+	size_t m_num_unused_in_slab = 0; // Nodes at the end of the last slab that were never handed out
+	size_t m_num_node_allocations = 0;
+	size_t m_num_live_nodes = 0;
+};
+
+
+// Standard allocator on top of a NODE_POOL, for node based containers. Containers allocate one node
+// at a time.
+template <typename T>
+class NODE_ALLOCATOR
+{
+public:
+	typedef T value_type;
+
+	NODE_ALLOCATOR() = delete;
+	explicit NODE_ALLOCATOR(NODE_POOL & pool) : m_pool(&pool) {}
+	template <typename U>
+	NODE_ALLOCATOR(const NODE_ALLOCATOR<U> & other) : m_pool(other.get_pool()) {}
+
+	T * allocate(size_t n)
+	{
+		assert(n == 1);
+		(void) n;
+		return static_cast<T *>(m_pool->allocate(sizeof(T)));
+	}
+
+	void deallocate(T * node, size_t)
+	{
+		m_pool->deallocate(node);
+	}
+
+	NODE_POOL * get_pool() const { return m_pool; }
+
+private:
+	NODE_POOL * m_pool;
+};
+
+template <typename T, typename U>
+bool operator==(const NODE_ALLOCATOR<T> & lhs, const NODE_ALLOCATOR<U> & rhs)
+{
+	return lhs.get_pool() == rhs.get_pool();
+}
+
+template <typename T, typename U>
+bool operator!=(const NODE_ALLOCATOR<T> & lhs, const NODE_ALLOCATOR<U> & rhs)
+{
+	return !(lhs == rhs);
+}
+
+} // End namespace WORKERS
+
+#endif
@@ -0,0 +1,310 @@
+
+#include "options.hh"
+#include "log.hh"
+#include "stats.hh"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+namespace OPTIONS
+{
+
+OPTION_MGR * OPTION_MGR::m_inst = nullptr;
+
+namespace
+{
+
+void l_print_usage(const char * exec_name)
+{
+	std::cerr << "Usage: " << exec_name << " [options] < input_file\n";
+	std::cerr << "       " << exec_name << " --batch LIST [options]\n";
+	std::cerr << "Options:\n";
+	std::cerr << "  --threads N    Evaluate dispatch candidates on N threads (default 1). In batch mode,\n";
+	std::cerr << "                 solve N inputs at once instead\n";
+	std::cerr << "  --stream       Dispatch jobs while they're read. Jobs must come in order of earliest\n";
+	std::cerr << "                 start time, after all workers\n";
+	std::cerr << "  --stream-window N\n";
+	std::cerr << "                 In streaming mode, never keep more than N jobs queued (default 64)\n";
+	std::cerr << "  --output-format text|csv|binary\n";
+	std::cerr << "                 How the schedule is written (default text):\n";
+	std::cerr << "                   text:   human readable history of every worker and job\n";
+	std::cerr << "                   csv:    job,worker,start per subtask\n";
+	std::cerr << "                   binary: uint32 job, uint32 worker, uint64 start per subtask,\n";
+	std::cerr << "                           little-endian\n";
+	std::cerr << "  --output FILE  Write the schedule to FILE instead of stdout\n";
+	std::cerr << "  --log-level none|error|warning|info|debug|trace\n";
+	std::cerr << "                 How much to log to stderr (default info). Levels above the one the\n";
+	std::cerr << "                 binary was built with (make LOG_LEVEL=<0-5>, default 4) are gone\n";
+	std::cerr << "  --trace FILE   Record dispatch and projection events in an in-memory ring, and dump\n";
+	std::cerr << "                 it to FILE at exit\n";
+	std::cerr << "  --trace-capacity N\n";
+	std::cerr << "                 Keep the last N trace events (default 1048576)\n";
+	std::cerr << "  --look-ahead N Keep trying up to N jobs past the best one so far (default 20)\n";
+	std::cerr << "  --priority-exponent F\n";
+	std::cerr << "                 Dispatch the job with the lowest ETA / priority^F (default 1)\n";
+	std::cerr << "  --queue-order early-cost|earliest-start|wspt\n";
+	std::cerr << "                 Order in which jobs are tried (default early-cost):\n";
+	std::cerr << "                   early-cost:     ETA on idle workers / priority\n";
+	std::cerr << "                   earliest-start: earliest start time\n";
+	std::cerr << "                   wspt:           total work / priority\n";
+	std::cerr << "  --portfolio N  Dispatch with the three options above and up to N - 1 built-in\n";
+	std::cerr << "                 variations at once, one process each, and keep the cheapest schedule\n";
+	std::cerr << "  --portfolio-early-abort\n";
+	std::cerr << "                 Stop a portfolio run once it costs more than a finished one\n";
+	std::cerr << "  --batch LIST   Solve every input file listed in LIST, one path per line (- for stdin),\n";
+	std::cerr << "                 in one process. Each schedule goes to <input>.schedule.<format>\n";
+	std::cerr << "  --output-dir DIR\n";
+	std::cerr << "                 In batch mode, write the schedules to DIR instead of next to the inputs\n";
+	std::cerr << "  --improve SECONDS\n";
+	std::cerr << "                 After dispatching, spend up to SECONDS moving jobs around to lower the\n";
+	std::cerr << "                 cost\n";
+	std::cerr << "  --improve-moves N\n";
+	std::cerr << "                 Same, but stop after N moves. Both can be given, the first limit wins\n";
+	std::cerr << "  --deadline MS  Write the schedule within MS milliseconds of the start. Dispatching tries\n";
+	std::cerr << "                 fewer jobs per pick as the deadline nears, and the time left over goes\n";
+	std::cerr << "                 to --improve\n";
+	std::cerr << "  --stats FILE   Collect dispatch statistics, and write them to FILE at exit (- for stdout)\n";
+	std::cerr << "                 (- needs --output when the schedule is csv or binary). Not in binaries\n";
+	std::cerr << "                 built with make STATS=0\n";
+	std::cerr << "  --stats-format table|json\n";
+	std::cerr << "                 How the statistics are written (default table)\n";
+	std::cerr << "  --help         Print this message\n";
+}
+
+[[noreturn]] void l_bad_usage(const char * exec_name, const std::string & error)
+{
+	std::cerr << "Error: " << error << std::endl;
+	l_print_usage(exec_name);
+	exit(1);
+}
+
+size_t l_parse_positive_number(const char * exec_name, const std::string & option, const char * value)
+{
+	if (value == nullptr)
+	{
+		l_bad_usage(exec_name, "Missing value for " + option);
+	}
+	char * end = nullptr;
+	unsigned long number = std::strtoul(value, &end, 10);
+	if (end == value || *end != '\0' || number == 0)
+	{
+		l_bad_usage(exec_name, "Expected a positive number for " + option + ", got " + value);
+	}
+	return number;
+}
+
+} // End anonymous namespace
+
+void OPTION_MGR::parse(int argc, char ** argv)
+{
+	m_parse_time = std::chrono::steady_clock::now();
+	const char * exec_name = argv[0];
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option(argv[i]);
+		const char * value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+		if (option == "--threads")
+		{
+			m_num_threads = l_parse_positive_number(exec_name, option, value);
+			++i;
+		}
+		else if (option == "--stream")
+		{
+			m_streaming = true;
+		}
+		else if (option == "--stream-window")
+		{
+			m_stream_window = l_parse_positive_number(exec_name, option, value);
+			++i;
+		}
+		else if (option == "--output-format")
+		{
+			std::string format_name = (value != nullptr) ? value : "";
+			if (format_name == "text") { m_output_format = OUTPUT_FORMAT::TEXT; }
+			else if (format_name == "csv") { m_output_format = OUTPUT_FORMAT::CSV; }
+			else if (format_name == "binary") { m_output_format = OUTPUT_FORMAT::BINARY; }
+			else { l_bad_usage(exec_name, "Unknown output format '" + format_name + "'"); }
+			++i;
+		}
+		else if (option == "--output")
+		{
+			if (value == nullptr || *value == '\0')
+			{
+				l_bad_usage(exec_name, "Missing value for " + option);
+			}
+			m_output_path = value;
+			++i;
+		}
+		else if (option == "--log-level")
+		{
+			LOG::LEVEL level;
+			if (value == nullptr || !LOG::LOGGER::parse_level(value, level))
+			{
+				l_bad_usage(exec_name, "Unknown log level '" + std::string(value ? value : "") + "'");
+			}
+			LOG::LOGGER::set_level(level);
+			++i;
+		}
+		else if (option == "--trace")
+		{
+			if (value == nullptr || *value == '\0')
+			{
+				l_bad_usage(exec_name, "Missing value for " + option);
+			}
+			m_trace_path = value;
+			++i;
+		}
+		else if (option == "--trace-capacity")
+		{
+			m_trace_capacity = l_parse_positive_number(exec_name, option, value);
+			++i;
+		}
+		else if (option == "--look-ahead")
+		{
+			m_dispatch_config.look_ahead = l_parse_positive_number(exec_name, option, value);
+			++i;
+		}
+		else if (option == "--priority-exponent")
+		{
+			char * end = nullptr;
+			float exponent = (value != nullptr) ? std::strtof(value, &end) : -1;
+			if (value == nullptr || end == value || *end != '\0' || !(exponent >= 0))
+			{
+				l_bad_usage(exec_name, "Expected a non negative number for " + option);
+			}
+			m_dispatch_config.priority_exponent = exponent;
+			++i;
+		}
+		else if (option == "--queue-order")
+		{
+			std::string order_name = (value != nullptr) ? value : "";
+			if (order_name == "early-cost") { m_dispatch_config.queue_order = QUEUE_ORDER::EARLY_COST; }
+			else if (order_name == "earliest-start") { m_dispatch_config.queue_order = QUEUE_ORDER::EARLIEST_START; }
+			else if (order_name == "wspt") { m_dispatch_config.queue_order = QUEUE_ORDER::WSPT; }
+			else { l_bad_usage(exec_name, "Unknown queue order '" + order_name + "'"); }
+			++i;
+		}
+		else if (option == "--portfolio")
+		{
+			m_portfolio_size = l_parse_positive_number(exec_name, option, value);
+			++i;
+		}
+		else if (option == "--portfolio-early-abort")
+		{
+			m_portfolio_early_abort = true;
+		}
+		else if (option == "--batch")
+		{
+			if (value == nullptr || *value == '\0')
+			{
+				l_bad_usage(exec_name, "Missing value for " + option);
+			}
+			m_batch_list_path = value;
+			++i;
+		}
+		else if (option == "--output-dir")
+		{
+			if (value == nullptr || *value == '\0')
+			{
+				l_bad_usage(exec_name, "Missing value for " + option);
+			}
+			m_output_dir = value;
+			++i;
+		}
+		else if (option == "--improve")
+		{
+			char * end = nullptr;
+			float seconds = (value != nullptr) ? std::strtof(value, &end) : 0;
+			if (value == nullptr || end == value || *end != '\0' || !(seconds > 0))
+			{
+				l_bad_usage(exec_name, "Expected a positive number of seconds for " + option);
+			}
+			m_improve_seconds = seconds;
+			++i;
+		}
+		else if (option == "--improve-moves")
+		{
+			m_improve_moves = l_parse_positive_number(exec_name, option, value);
+			++i;
+		}
+		else if (option == "--deadline")
+		{
+			m_deadline_ms = l_parse_positive_number(exec_name, option, value);
+			++i;
+		}
+		else if (option == "--stats")
+		{
+			if (value == nullptr || *value == '\0')
+			{
+				l_bad_usage(exec_name, "Missing value for " + option);
+			}
+			if (!SCHED_STATS_ENABLED)
+			{
+				l_bad_usage(exec_name, "--stats needs a binary built with STATS=1");
+			}
+			m_stats_path = value;
+			++i;
+		}
+		else if (option == "--stats-format")
+		{
+			std::string format_name = (value != nullptr) ? value : "";
+			if (format_name == "table") { m_stats_as_json = false; }
+			else if (format_name == "json") { m_stats_as_json = true; }
+			else { l_bad_usage(exec_name, "Unknown stats format '" + format_name + "'"); }
+			++i;
+		}
+		else if (option == "--help")
+		{
+			l_print_usage(exec_name);
+			exit(0);
+		}
+		else
+		{
+			l_bad_usage(exec_name, "Unknown option " + option);
+		}
+	}
+
+	// Runs other than the picked one are thrown away, and so would be what they traced or counted.
+	if (m_portfolio_size > 0 && (m_streaming || !m_trace_path.empty() || !m_stats_path.empty()))
+	{
+		l_bad_usage(exec_name, "--portfolio doesn't go with --stream, --trace or --stats");
+	}
+	// Trace events don't say which instance they're from
+	bool is_batch = !m_batch_list_path.empty();
+	if (is_batch && (m_streaming || m_portfolio_size > 0 || !m_output_path.empty() || !m_trace_path.empty()))
+	{
+		l_bad_usage(exec_name, "--batch doesn't go with --stream, --portfolio, --output or --trace");
+	}
+	// Streamed subtasks are already written, and portfolio runs are compared as they are dispatched
+	if (is_improving() && (m_streaming || m_portfolio_size > 0))
+	{
+		l_bad_usage(exec_name, "--improve and --improve-moves don't go with --stream or --portfolio");
+	}
+	// The deadline is for the one schedule the process writes, and it must be complete
+	if (m_deadline_ms > 0 && (m_streaming || m_portfolio_size > 0 || is_batch))
+	{
+		l_bad_usage(exec_name, "--deadline doesn't go with --stream, --portfolio or --batch");
+	}
+	// A csv or binary schedule on stdout has to be all that's there to be read back
+	if (!is_batch && m_output_format != OUTPUT_FORMAT::TEXT && m_output_path.empty() && m_stats_path == "-")
+	{
+		l_bad_usage(exec_name, "--stats - needs --output with --output-format csv or binary");
+	}
+	if (!is_batch && !m_output_dir.empty())
+	{
+		l_bad_usage(exec_name, "--output-dir only goes with --batch");
+	}
+}
+
+OPTION_MGR & OPTION_MGR::get_inst()
+{
+	if (m_inst == nullptr)
+	{
+		m_inst = new OPTION_MGR;
+	}
+	return *m_inst;
+}
+
+} // End namespace OPTIONS
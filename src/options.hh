@@ -0,0 +1,86 @@
+#ifndef OPTIONS_HH
+#define OPTIONS_HH
+
+#include <cstddef>
+#include <string>
+#include <chrono>
+
+namespace OPTIONS
+{
+
+enum class OUTPUT_FORMAT { TEXT, CSV, BINARY }; // See OUTPUT::SCHEDULE_WRITER
+enum class QUEUE_ORDER { EARLY_COST, EARLIEST_START, WSPT }; // See JOBS::JOB_QUEUE
+
+// Knobs of the dispatch heuristic. The defaults are what the dispatcher always did.
+struct DISPATCH_CONFIG
+{
+	size_t look_ahead = 20; // Jobs tried past the best one so far before the search gives up
+	float priority_exponent = 1; // A job's pick cost is its ETA / priority^priority_exponent
+	QUEUE_ORDER queue_order = QUEUE_ORDER::EARLY_COST;
+};
+
+// Command line options. Parsed once in main, read from anywhere afterwards.
+class OPTION_MGR
+{
+public:
+	OPTION_MGR & operator=(const OPTION_MGR &) = delete;
+	OPTION_MGR & operator=(OPTION_MGR &&) = delete;
+
+	// Modifiers
+	void parse(int argc, char ** argv);
+	void set_dispatch_config(const DISPATCH_CONFIG & config) { m_dispatch_config = config; } // Portfolio mode
+
+	// Getters
+	size_t get_num_threads() const { return m_num_threads; }
+	bool is_streaming() const { return m_streaming; }
+	size_t get_stream_window() const { return m_stream_window; }
+	OUTPUT_FORMAT get_output_format() const { return m_output_format; }
+	const std::string & get_output_path() const { return m_output_path; } // Empty for stdout
+	const std::string & get_trace_path() const { return m_trace_path; } // Empty if not tracing
+	size_t get_trace_capacity() const { return m_trace_capacity; }
+	const std::string & get_stats_path() const { return m_stats_path; } // Empty if not collecting stats
+	bool get_stats_as_json() const { return m_stats_as_json; }
+	const DISPATCH_CONFIG & get_dispatch_config() const { return m_dispatch_config; }
+	size_t get_portfolio_size() const { return m_portfolio_size; } // 0 if not in portfolio mode
+	bool get_portfolio_early_abort() const { return m_portfolio_early_abort; }
+	const std::string & get_batch_list_path() const { return m_batch_list_path; } // Empty if not in batch mode
+	const std::string & get_output_dir() const { return m_output_dir; } // Empty for next to each input
+	bool is_improving() const { return m_improve_seconds > 0 || m_improve_moves > 0; }
+	float get_improve_seconds() const { return m_improve_seconds; } // 0 for no limit
+	size_t get_improve_moves() const { return m_improve_moves; } // Same
+	size_t get_deadline_ms() const { return m_deadline_ms; } // 0 if none
+	std::chrono::steady_clock::time_point get_parse_time() const { return m_parse_time; } // The deadline counts from it
+
+	static OPTION_MGR & get_inst();
+
+private:
+	OPTION_MGR() = default;
+	OPTION_MGR(const OPTION_MGR &) = delete;
+	OPTION_MGR(OPTION_MGR &&) = delete;
+	~OPTION_MGR() = default;
+
+	size_t m_num_threads = 1;
+	bool m_streaming = false;
+	size_t m_stream_window = 64;
+	OUTPUT_FORMAT m_output_format = OUTPUT_FORMAT::TEXT;
+	std::string m_output_path;
+	std::string m_trace_path;
+	size_t m_trace_capacity = 1 << 20;
+	std::string m_stats_path;
+	bool m_stats_as_json = false;
+	DISPATCH_CONFIG m_dispatch_config;
+	size_t m_portfolio_size = 0;
+	bool m_portfolio_early_abort = false;
+	std::string m_batch_list_path;
+	std::string m_output_dir;
+	float m_improve_seconds = 0;
+	size_t m_improve_moves = 0;
+	size_t m_deadline_ms = 0;
+	std::chrono::steady_clock::time_point m_parse_time;
+
+	static OPTION_MGR * m_inst;
+};
+
+} // End namespace OPTIONS
+
+#endif
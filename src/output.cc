@@ -0,0 +1,221 @@
+
+#include "output.hh"
+#include "context.hh"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace OUTPUT
+{
+
+BUFFERED_WRITER::BUFFERED_WRITER(int fd, size_t capacity)
+: m_fd(fd), m_buffer(capacity)
+{
+	assert(capacity >= 32); // Room for any number
+}
+
+BUFFERED_WRITER::~BUFFERED_WRITER()
+{
+	flush();
+}
+
+void BUFFERED_WRITER::put(const char * str, size_t length)
+{
+	while (length > 0)
+	{
+		if (m_size == m_buffer.size()) { flush(); }
+		size_t chunk = std::min(length, m_buffer.size() - m_size);
+		std::memcpy(m_buffer.data() + m_size, str, chunk);
+		m_size += chunk;
+		str += chunk;
+		length -= chunk;
+	}
+}
+
+void BUFFERED_WRITER::put_decimal(uint64_t number)
+{
+	char digits[20];
+	size_t num_digits = 0;
+	do
+	{
+		digits[num_digits++] = char('0' + number % 10);
+		number /= 10;
+	} while (number != 0);
+
+	if (m_buffer.size() - m_size < num_digits) { flush(); }
+	while (num_digits > 0)
+	{
+		m_buffer[m_size++] = digits[--num_digits];
+	}
+}
+
+void BUFFERED_WRITER::put_le32(uint32_t number)
+{
+	if (m_buffer.size() - m_size < 4) { flush(); }
+	for (size_t i = 0; i < 4; ++i)
+	{
+		m_buffer[m_size++] = char((number >> (8 * i)) & 0xff);
+	}
+}
+
+void BUFFERED_WRITER::put_le64(uint64_t number)
+{
+	if (m_buffer.size() - m_size < 8) { flush(); }
+	for (size_t i = 0; i < 8; ++i)
+	{
+		m_buffer[m_size++] = char((number >> (8 * i)) & 0xff);
+	}
+}
+
+void BUFFERED_WRITER::flush()
+{
+	if (m_fd == STDOUT_FILENO)
+	{
+		// Keep the order with whatever went through std::cout before
+		std::cout.flush();
+	}
+
+	const char * data = m_buffer.data();
+	size_t remaining = m_size;
+	while (remaining > 0)
+	{
+		ssize_t num_written = write(m_fd, data, remaining);
+		if (num_written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (num_written < 0)
+		{
+			std::cerr << "Error: Failed to write output: " << std::strerror(errno) << std::endl;
+			exit(1);
+		}
+		data += num_written;
+		remaining -= num_written;
+	}
+	m_size = 0;
+}
+
+SCHEDULE_WRITER::SCHEDULE_WRITER(FORMAT format, int fd)
+: m_format(format), m_fd(fd), m_writer(fd)
+{
+	if (m_format == FORMAT::CSV)
+	{
+		m_writer.put("job,worker,start\n", 17);
+	}
+}
+
+SCHEDULE_WRITER::~SCHEDULE_WRITER()
+{
+	m_writer.flush();
+	if (m_fd != STDOUT_FILENO)
+	{
+		close(m_fd);
+	}
+}
+
+void SCHEDULE_WRITER::write_subtask(const JOBS::JOB_ENTRY & job, WORKERS::WORKER::WORKER_IDX worker_idx, JOBS::TIME start_time)
+{
+	switch (m_format)
+	{
+	case FORMAT::TEXT:
+		m_writer.put("Placed job #", 12);
+		m_writer.put_decimal(job.get_index());
+		m_writer.put(' ');
+		m_writer.put(job.get_name());
+		m_writer.put(" on worker #", 12);
+		m_writer.put_decimal(worker_idx);
+		m_writer.put(" at ", 4);
+		m_writer.put_decimal(start_time);
+		m_writer.put('\n');
+		break;
+	case FORMAT::CSV:
+		m_writer.put_decimal(job.get_index());
+		m_writer.put(',');
+		m_writer.put_decimal(worker_idx);
+		m_writer.put(',');
+		m_writer.put_decimal(start_time);
+		m_writer.put('\n');
+		break;
+	case FORMAT::BINARY:
+		assert(job.get_index() <= UINT32_MAX && worker_idx <= UINT32_MAX);
+		m_writer.put_le32(uint32_t(job.get_index()));
+		m_writer.put_le32(uint32_t(worker_idx));
+		m_writer.put_le64(start_time);
+		break;
+	}
+}
+
+void SCHEDULE_WRITER::write_schedule(const WORKERS::WORKER_MGR & worker_mgr)
+{
+	if (m_format == FORMAT::TEXT)
+	{
+		// Same lines as SUBTASK_RUN::to_string(), with each job described only once
+		const JOBS::JOB_POOL & job_pool = JOBS::JOB_POOL::get_inst();
+		std::vector<std::string> job_strings(job_pool.size());
+		for (JOBS::JOB_IDX job_idx = 0; job_idx < job_pool.size(); ++job_idx)
+		{
+			job_strings[job_idx] = job_pool[job_idx].to_string();
+		}
+
+		m_writer.put("Here's the subtask history on each machine: \n");
+		for (auto worker_iter = worker_mgr.cbegin(); worker_iter != worker_mgr.cend(); ++worker_iter)
+		{
+			m_writer.put("Worker #");
+			m_writer.put_decimal(worker_iter->get_index());
+			m_writer.put(' ');
+			m_writer.put(worker_iter->get_name());
+			m_writer.put(" execution history: \n");
+			for (const WORKERS::SUBTASK_RUN & run: worker_iter->get_history())
+			{
+				const std::string & job_string = job_strings[run.get_job_index()];
+				for (size_t i = 0; i < run.get_num_subtasks(); ++i)
+				{
+					m_writer.put("  ");
+					m_writer.put(job_string);
+					m_writer.put(": ");
+					m_writer.put_decimal(run.get_subtask_start_time(i));
+					m_writer.put(' ');
+					m_writer.put_decimal(run.get_subtask_start_time(i + 1));
+					m_writer.put('\n');
+				}
+			}
+		}
+		//TODO: Check all jobs are executed once and only once. Write some more checks.
+		m_writer.put("Here's the overall job status after dispatching all:\n");
+		for (const std::string & job_string: job_strings)
+		{
+			m_writer.put(job_string);
+			m_writer.put('\n');
+		}
+		return;
+	}
+
+	for (auto worker_iter = worker_mgr.cbegin(); worker_iter != worker_mgr.cend(); ++worker_iter)
+	{
+		for (const WORKERS::SUBTASK_RUN & run: worker_iter->get_history())
+		{
+			const JOBS::JOB_ENTRY job = run.get_job();
+			for (size_t i = 0; i < run.get_num_subtasks(); ++i)
+			{
+				write_subtask(job, worker_iter->get_index(), run.get_subtask_start_time(i));
+			}
+		}
+	}
+}
+
+void SCHEDULE_WRITER::flush()
+{
+	m_writer.flush();
+}
+
+SCHEDULE_WRITER & SCHEDULE_WRITER::get_inst()
+{
+	return CONTEXT::SCHED_CONTEXT::get_current().get_schedule_writer();
+}
+
+} // End namespace OUTPUT
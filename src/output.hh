@@ -0,0 +1,89 @@
+#ifndef OUTPUT_HH
+#define OUTPUT_HH
+
+#include "jobs.hh"
+#include "workers.hh"
+#include "options.hh"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace CONTEXT
+{
+class SCHED_CONTEXT;
+}
+
+namespace OUTPUT
+{
+
+// Appends to a file descriptor through a fixed buffer. No allocation or flush per write.
+class BUFFERED_WRITER
+{
+public:
+	BUFFERED_WRITER() = delete;
+	BUFFERED_WRITER(const BUFFERED_WRITER &) = delete;
+	BUFFERED_WRITER(BUFFERED_WRITER &&) = delete;
+	BUFFERED_WRITER & operator=(const BUFFERED_WRITER &) = delete;
+	BUFFERED_WRITER & operator=(BUFFERED_WRITER &&) = delete;
+
+	explicit BUFFERED_WRITER(int fd, size_t capacity = 1 << 16);
+	~BUFFERED_WRITER();
+
+	void put(char c)
+	{
+		if (m_size == m_buffer.size()) { flush(); }
+		m_buffer[m_size++] = c;
+	}
+	void put(const char * str, size_t length);
+	void put(const std::string & str) { put(str.data(), str.size()); }
+	void put_decimal(uint64_t number);
+	void put_le32(uint32_t number);
+	void put_le64(uint64_t number);
+
+	void flush();
+
+private:
+	int m_fd;
+	std::vector<char> m_buffer;
+	size_t m_size = 0;
+};
+
+// Writes where subtasks went, in the format picked by --output-format:
+//  - text:   "Placed job #<job> <name> on worker #<worker> at <start>" per subtask while streaming,
+//            and the full execution history and job status dump at the end. This is the default.
+//  - csv:    "<job>,<worker>,<start>" per subtask, after a "job,worker,start" header.
+//  - binary: 16 bytes per subtask, all little-endian: uint32 job, uint32 worker, uint64 start.
+// Job and worker are indices (see JOB_ENTRY::get_index and WORKER::get_index).
+class SCHEDULE_WRITER
+{
+public:
+	typedef OPTIONS::OUTPUT_FORMAT FORMAT;
+
+	SCHEDULE_WRITER & operator=(const SCHEDULE_WRITER &) = delete;
+	SCHEDULE_WRITER & operator=(SCHEDULE_WRITER &&) = delete;
+
+	void write_subtask(const JOBS::JOB_ENTRY & job, WORKERS::WORKER::WORKER_IDX worker_idx, JOBS::TIME start_time);
+	void write_schedule(const WORKERS::WORKER_MGR & worker_mgr);
+	void flush();
+
+	FORMAT get_format() const { return m_format; }
+
+	static SCHEDULE_WRITER & get_inst();
+
+private:
+	friend class CONTEXT::SCHED_CONTEXT;
+
+	SCHEDULE_WRITER(FORMAT format, int fd);
+	SCHEDULE_WRITER(const SCHEDULE_WRITER &) = delete;
+	SCHEDULE_WRITER(SCHEDULE_WRITER &&) = delete;
+	~SCHEDULE_WRITER(); // Closes the file, if it's not stdout
+
+	FORMAT m_format;
+	int m_fd;
+	BUFFERED_WRITER m_writer;
+};
+
+} // End namespace OUTPUT
+
+#endif
@@ -0,0 +1,283 @@
+
+#include "portfolio.hh"
+#include "jobs.hh"
+#include "dispatcher.hh"
+#include "options.hh"
+#include "log.hh"
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <new>
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+namespace PORTFOLIO
+{
+
+namespace
+{
+
+// Tried after the settings from the command line, in this order
+const OPTIONS::DISPATCH_CONFIG l_builtin_configs[] = {
+	{20, 1, OPTIONS::QUEUE_ORDER::EARLY_COST},
+	{40, 1, OPTIONS::QUEUE_ORDER::EARLY_COST},
+	{20, 1, OPTIONS::QUEUE_ORDER::WSPT},
+	{20, 0.5, OPTIONS::QUEUE_ORDER::EARLY_COST},
+	{20, 2, OPTIONS::QUEUE_ORDER::EARLY_COST},
+	{20, 1, OPTIONS::QUEUE_ORDER::EARLIEST_START},
+	{10, 1, OPTIONS::QUEUE_ORDER::EARLY_COST},
+	{80, 1, OPTIONS::QUEUE_ORDER::EARLY_COST},
+};
+
+const char l_command_write = 'w';
+
+struct RESULT
+{
+	bool finished;
+	JOBS::COST_CALC::COST cost;
+};
+
+struct RUN
+{
+	OPTIONS::DISPATCH_CONFIG config;
+	pid_t pid;
+	int result_fd;  // Read end, the child writes one RESULT
+	int command_fd; // Write end, the child waits for one command byte or the end of the pipe
+	RESULT result;
+};
+
+bool l_same_config(const OPTIONS::DISPATCH_CONFIG & lhs, const OPTIONS::DISPATCH_CONFIG & rhs)
+{
+	return lhs.look_ahead == rhs.look_ahead && lhs.priority_exponent == rhs.priority_exponent
+		&& lhs.queue_order == rhs.queue_order;
+}
+
+const char * l_queue_order_name(OPTIONS::QUEUE_ORDER queue_order)
+{
+	switch (queue_order)
+	{
+	case OPTIONS::QUEUE_ORDER::EARLY_COST: return "early-cost";
+	case OPTIONS::QUEUE_ORDER::EARLIEST_START: return "earliest-start";
+	case OPTIONS::QUEUE_ORDER::WSPT: return "wspt";
+	}
+	return "?";
+}
+
+std::string l_config_to_string(const OPTIONS::DISPATCH_CONFIG & config)
+{
+	std::ostringstream oss;
+	oss << "--look-ahead " << config.look_ahead << " --priority-exponent " << config.priority_exponent
+		<< " --queue-order " << l_queue_order_name(config.queue_order);
+	return oss.str();
+}
+
+// The command line settings first, then the built-in ones that differ from them
+std::vector<OPTIONS::DISPATCH_CONFIG> l_get_configs(size_t portfolio_size)
+{
+	const OPTIONS::DISPATCH_CONFIG & cmd_line_config = OPTIONS::OPTION_MGR::get_inst().get_dispatch_config();
+	std::vector<OPTIONS::DISPATCH_CONFIG> configs(1, cmd_line_config);
+	for (const OPTIONS::DISPATCH_CONFIG & config: l_builtin_configs)
+	{
+		if (configs.size() < portfolio_size && !l_same_config(config, cmd_line_config))
+		{
+			configs.push_back(config);
+		}
+	}
+	if (configs.size() < portfolio_size)
+	{
+		SCHED_LOG(WARNING) << "Portfolio has only " << configs.size() << " dispatch settings, not " << portfolio_size;
+	}
+	return configs;
+}
+
+void l_write_all(int fd, const void * data, size_t size)
+{
+	const char * bytes = static_cast<const char *>(data);
+	while (size > 0)
+	{
+		ssize_t num_written = write(fd, bytes, size);
+		if (num_written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		assert(num_written > 0);
+		bytes += num_written;
+		size -= num_written;
+	}
+}
+
+// Returns false on end of file
+bool l_read_all(int fd, void * data, size_t size)
+{
+	char * bytes = static_cast<char *>(data);
+	while (size > 0)
+	{
+		ssize_t num_read = read(fd, bytes, size);
+		if (num_read < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (num_read <= 0)
+		{
+			return false;
+		}
+		bytes += num_read;
+		size -= num_read;
+	}
+	return true;
+}
+
+void l_lower_best_cost(std::atomic<JOBS::COST_CALC::COST> & best_cost, JOBS::COST_CALC::COST cost)
+{
+	JOBS::COST_CALC::COST seen = best_cost.load(std::memory_order_relaxed);
+	while (cost < seen && !best_cost.compare_exchange_weak(seen, cost, std::memory_order_relaxed))
+	{
+	}
+}
+
+// In the child process. Never returns.
+void l_run(const OPTIONS::DISPATCH_CONFIG & config, std::atomic<JOBS::COST_CALC::COST> & best_cost, bool early_abort,
+	int result_fd, int command_fd)
+{
+	// Only the winner's output should get through
+	LOG::LEVEL log_level = LOG::LOGGER::get_level();
+	LOG::LOGGER::set_level(std::min(log_level, LOG::LEVEL::WARNING));
+
+	OPTIONS::OPTION_MGR::get_inst().set_dispatch_config(config);
+	JOBS::JOB_QUEUE::load();
+
+	// Nobody lowers this one
+	std::atomic<JOBS::COST_CALC::COST> no_bound(std::numeric_limits<JOBS::COST_CALC::COST>::infinity());
+	RESULT result;
+	result.finished = DISPATCHER::dispatch_all_below(early_abort ? best_cost : no_bound);
+	result.cost = 0;
+	if (result.finished)
+	{
+		result.cost = JOBS::COST_CALC::get_total_cost();
+		l_lower_best_cost(best_cost, result.cost);
+	}
+	l_write_all(result_fd, &result, sizeof(result));
+	close(result_fd);
+
+	char command;
+	if (l_read_all(command_fd, &command, 1) && command == l_command_write)
+	{
+		LOG::LOGGER::set_level(log_level);
+		DISPATCHER::write_schedule();
+	}
+	_exit(0);
+}
+
+} // End anonymous namespace
+
+void solve()
+{
+	const OPTIONS::OPTION_MGR & options = OPTIONS::OPTION_MGR::get_inst();
+	std::vector<OPTIONS::DISPATCH_CONFIG> configs = l_get_configs(options.get_portfolio_size());
+	bool early_abort = options.get_portfolio_early_abort();
+
+	// Lowest cost of the runs done so far, shared with all of them
+	void * shared = mmap(nullptr, sizeof(std::atomic<JOBS::COST_CALC::COST>), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+	{
+		std::cerr << "Error: Can't map memory for the portfolio: " << std::strerror(errno) << "\n";
+		exit(1);
+	}
+	std::atomic<JOBS::COST_CALC::COST> & best_cost = *new (shared) std::atomic<JOBS::COST_CALC::COST>(std::numeric_limits<JOBS::COST_CALC::COST>::infinity());
+	assert(best_cost.is_lock_free());
+
+	SCHED_LOG(INFO) << "Dispatching with " << configs.size() << " settings at once...";
+	std::vector<RUN> runs;
+	for (const OPTIONS::DISPATCH_CONFIG & config: configs)
+	{
+		int result_pipe[2];
+		int command_pipe[2];
+		if (pipe(result_pipe) != 0 || pipe(command_pipe) != 0)
+		{
+			std::cerr << "Error: Can't create pipe: " << std::strerror(errno) << "\n";
+			exit(1);
+		}
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			std::cerr << "Error: Can't fork: " << std::strerror(errno) << "\n";
+			exit(1);
+		}
+		if (pid == 0)
+		{
+			// The ends of the earlier runs' pipes came along too. Close them, so those children
+			// still see the end of their command pipe.
+			for (const RUN & run: runs)
+			{
+				close(run.result_fd);
+				close(run.command_fd);
+			}
+			close(result_pipe[0]);
+			close(command_pipe[1]);
+			l_run(config, best_cost, early_abort, result_pipe[1], command_pipe[0]);
+		}
+		close(result_pipe[1]);
+		close(command_pipe[0]);
+		runs.push_back(RUN{config, pid, result_pipe[0], command_pipe[1], RESULT{false, 0}});
+	}
+
+	RUN * best_run = nullptr;
+	for (RUN & run: runs)
+	{
+		if (!l_read_all(run.result_fd, &run.result, sizeof(run.result)))
+		{
+			std::cerr << "Error: A portfolio run died before it was done\n";
+			exit(1);
+		}
+		close(run.result_fd);
+		if (run.result.finished && (best_run == nullptr || run.result.cost < best_run->result.cost))
+		{
+			best_run = &run;
+		}
+	}
+	// At least the run that finished first can't have been aborted
+	assert(best_run != nullptr);
+
+	for (RUN & run: runs)
+	{
+		if (&run == best_run)
+		{
+			l_write_all(run.command_fd, &l_command_write, 1);
+		}
+		close(run.command_fd);
+	}
+	for (const RUN & run: runs)
+	{
+		int status;
+		while (waitpid(run.pid, &status, 0) < 0 && errno == EINTR)
+		{
+		}
+	}
+	munmap(shared, sizeof(std::atomic<JOBS::COST_CALC::COST>));
+
+	for (const RUN & run: runs)
+	{
+		if (run.result.finished)
+		{
+			SCHED_LOG(INFO) << "Portfolio: " << l_config_to_string(run.config) << " cost " << run.result.cost;
+		}
+		else
+		{
+			SCHED_LOG(INFO) << "Portfolio: " << l_config_to_string(run.config) << " aborted";
+		}
+	}
+	SCHED_LOG(INFO) << "Picked " << l_config_to_string(best_run->config);
+	SCHED_LOG(INFO) << "Sum Cost: " << best_run->result.cost;
+}
+
+} // End namespace PORTFOLIO
@@ -0,0 +1,14 @@
+#ifndef PORTFOLIO_HH
+#define PORTFOLIO_HH
+
+namespace PORTFOLIO
+{
+
+// Dispatches the loaded jobs once per dispatch setting in the portfolio, all at once, then writes
+// the cheapest schedule and logs its cost. Each setting runs in a process of its own, forked once
+// the input is loaded, as the dispatch settings are process-wide options.
+void solve();
+
+} // End namespace PORTFOLIO
+
+#endif
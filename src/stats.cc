@@ -0,0 +1,191 @@
+
+#include "stats.hh"
+
+#include <iomanip>
+#include <algorithm>
+#include <cassert>
+
+namespace STATS
+{
+
+constexpr size_t STATS_MGR::NUM_BUCKETS;
+std::mutex STATS_MGR::m_mutex;
+std::vector<std::unique_ptr<STATS_MGR::THREAD_BLOCK>> STATS_MGR::m_blocks;
+bool STATS_MGR::m_histograms_enabled = false;
+
+namespace
+{
+
+const char * l_get_counter_name(COUNTER counter)
+{
+	switch (counter)
+	{
+	case COUNTER::DISPATCHES: return "dispatches";
+	case COUNTER::JOBS_CONSIDERED: return "jobs_considered";
+	case COUNTER::PROJECTIONS_PRUNED: return "projections_pruned";
+	case COUNTER::PROJECTION_CACHE_HITS: return "projection_cache_hits";
+	case COUNTER::PROJECTION_CACHE_MISSES: return "projection_cache_misses";
+	case COUNTER::HISTORY_NODE_ALLOCATIONS: return "history_node_allocations";
+	case COUNTER::HISTORY_SLAB_ALLOCATIONS: return "history_slab_allocations";
+	case COUNTER::IMPROVE_MOVES_TRIED: return "improve_moves_tried";
+	case COUNTER::IMPROVE_MOVES_ACCEPTED: return "improve_moves_accepted";
+	case COUNTER::NUM_COUNTERS: break;
+	}
+	return "unknown";
+}
+
+const char * l_get_histogram_name(HISTOGRAM histogram)
+{
+	switch (histogram)
+	{
+	case HISTOGRAM::JOBS_TRIED_PER_DISPATCH: return "jobs_tried_per_dispatch";
+	case HISTOGRAM::PICKED_ATTEMPT: return "picked_attempt";
+	case HISTOGRAM::GIVE_UP_COST_PERCENT: return "give_up_cost_percent";
+	case HISTOGRAM::HOLES_VISITED_PER_SLOT_SEARCH: return "holes_visited_per_slot_search";
+	case HISTOGRAM::WORKERS_EVALUATED_PER_SUBTASK: return "workers_evaluated_per_subtask";
+	case HISTOGRAM::PROJECTION_NS: return "projection_ns";
+	case HISTOGRAM::NUM_HISTOGRAMS: break;
+	}
+	return "unknown";
+}
+
+size_t l_get_bucket(uint64_t value)
+{
+	size_t bucket = 0;
+	while (value != 0)
+	{
+		value >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+// Smallest and largest value a bucket holds
+uint64_t l_get_bucket_low(size_t bucket)
+{
+	return (bucket == 0) ? 0 : uint64_t(1) << (bucket - 1);
+}
+
+uint64_t l_get_bucket_high(size_t bucket)
+{
+	return (bucket == 0) ? 0 : (bucket == 64) ? UINT64_MAX : (uint64_t(1) << bucket) - 1;
+}
+
+} // End anonymous namespace
+
+void STATS_MGR::record(HISTOGRAM histogram, uint64_t value, uint64_t num_samples)
+{
+	HISTOGRAM_DATA & data = get_thread_block().histograms[size_t(histogram)];
+	bump(data.num_samples, num_samples);
+	bump(data.sum, value * num_samples);
+	bump(data.buckets[l_get_bucket(value)], num_samples);
+	if (value > data.max.load(std::memory_order_relaxed))
+	{
+		data.max.store(value, std::memory_order_relaxed);
+	}
+}
+
+STATS_MGR::THREAD_BLOCK * STATS_MGR::register_thread()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_blocks.emplace_back(new THREAD_BLOCK);
+	return m_blocks.back().get();
+}
+
+uint64_t STATS_MGR::get_counter(COUNTER counter)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint64_t sum = 0;
+	for (const auto & block: m_blocks)
+	{
+		sum += block->counters[size_t(counter)].load(std::memory_order_relaxed);
+	}
+	return sum;
+}
+
+STATS_MGR::MERGED_HISTOGRAM STATS_MGR::merge(HISTOGRAM histogram)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	MERGED_HISTOGRAM merged;
+	for (const auto & block: m_blocks)
+	{
+		const HISTOGRAM_DATA & data = block->histograms[size_t(histogram)];
+		merged.num_samples += data.num_samples.load(std::memory_order_relaxed);
+		merged.sum += data.sum.load(std::memory_order_relaxed);
+		merged.max = std::max(merged.max, data.max.load(std::memory_order_relaxed));
+		for (size_t bucket = 0; bucket < NUM_BUCKETS; ++bucket)
+		{
+			merged.buckets[bucket] += data.buckets[bucket].load(std::memory_order_relaxed);
+		}
+	}
+	return merged;
+}
+
+// Percentiles are the top of the bucket they fall in, so they're within a factor of two.
+void STATS_MGR::dump(std::ostream & os, FORMAT format)
+{
+	const size_t num_counters = size_t(COUNTER::NUM_COUNTERS);
+	const size_t num_histograms = size_t(HISTOGRAM::NUM_HISTOGRAMS);
+
+	if (format == FORMAT::JSON)
+	{
+		os << "{\n  \"counters\": {";
+		for (size_t i = 0; i < num_counters; ++i)
+		{
+			os << (i == 0 ? "\n" : ",\n") << "    \"" << l_get_counter_name(COUNTER(i)) << "\": "
+				<< get_counter(COUNTER(i));
+		}
+		os << "\n  },\n  \"histograms\": {";
+		for (size_t i = 0; i < num_histograms; ++i)
+		{
+			MERGED_HISTOGRAM merged = merge(HISTOGRAM(i));
+			os << (i == 0 ? "\n" : ",\n") << "    \"" << l_get_histogram_name(HISTOGRAM(i)) << "\": {\"samples\": "
+				<< merged.num_samples << ", \"sum\": " << merged.sum << ", \"max\": " << merged.max << ", \"buckets\": [";
+			bool first = true;
+			for (size_t bucket = 0; bucket < NUM_BUCKETS; ++bucket)
+			{
+				if (merged.buckets[bucket] != 0)
+				{
+					os << (first ? "" : ", ") << "{\"low\": " << l_get_bucket_low(bucket) << ", \"high\": "
+						<< l_get_bucket_high(bucket) << ", \"samples\": " << merged.buckets[bucket] << "}";
+					first = false;
+				}
+			}
+			os << "]}";
+		}
+		os << "\n  }\n}\n";
+		return;
+	}
+
+	os << std::left << std::setw(32) << "counter" << std::right << std::setw(14) << "value" << "\n";
+	for (size_t i = 0; i < num_counters; ++i)
+	{
+		os << std::left << std::setw(32) << l_get_counter_name(COUNTER(i)) << std::right << std::setw(14)
+			<< get_counter(COUNTER(i)) << "\n";
+	}
+	os << "\n" << std::left << std::setw(32) << "histogram" << std::right << std::setw(14) << "samples"
+		<< std::setw(12) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+		<< std::setw(12) << "max" << "\n";
+	for (size_t i = 0; i < num_histograms; ++i)
+	{
+		MERGED_HISTOGRAM merged = merge(HISTOGRAM(i));
+		os << std::left << std::setw(32) << l_get_histogram_name(HISTOGRAM(i)) << std::right << std::setw(14)
+			<< merged.num_samples << std::setw(12) << std::fixed << std::setprecision(1)
+			<< (merged.num_samples ? double(merged.sum) / merged.num_samples : 0.0);
+		for (double fraction: {0.5, 0.9, 0.99})
+		{
+			uint64_t rank = uint64_t(fraction * merged.num_samples);
+			uint64_t seen = 0;
+			size_t bucket = 0;
+			while (bucket + 1 < NUM_BUCKETS && seen + merged.buckets[bucket] <= rank)
+			{
+				seen += merged.buckets[bucket];
+				++bucket;
+			}
+			os << std::setw(10) << (merged.num_samples ? std::min(l_get_bucket_high(bucket), merged.max) : 0);
+		}
+		os << std::setw(12) << merged.max << "\n";
+	}
+}
+
+} // End namespace STATS
@@ -0,0 +1,182 @@
+#ifndef STATS_HH
+#define STATS_HH
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Stat sites are compiled out entirely with "make STATS=0".
+#ifndef SCHED_STATS_ENABLED
+#define SCHED_STATS_ENABLED 1
+#endif
+
+namespace STATS
+{
+
+enum class COUNTER : uint32_t
+{
+	DISPATCHES,
+	JOBS_CONSIDERED,          // By the dispatcher, pruned or not
+	PROJECTIONS_PRUNED,       // By the dispatcher's cost lower bound
+	PROJECTION_CACHE_HITS,
+	PROJECTION_CACHE_MISSES,
+	HISTORY_NODE_ALLOCATIONS, // Copied from the node pool once dispatching is done
+	HISTORY_SLAB_ALLOCATIONS, // Same
+	IMPROVE_MOVES_TRIED,      // By the local search
+	IMPROVE_MOVES_ACCEPTED,
+	NUM_COUNTERS
+};
+
+enum class HISTOGRAM : uint32_t
+{
+	JOBS_TRIED_PER_DISPATCH,
+	PICKED_ATTEMPT,                // Index of the picked job among the ones tried
+	GIVE_UP_COST_PERCENT,          // Cost of the job that ended the search, relative to the best one
+	HOLES_VISITED_PER_SLOT_SEARCH, // Hole index nodes
+	WORKERS_EVALUATED_PER_SUBTASK, // Slot searches done to place it
+	PROJECTION_NS,                 // Without the ETA cache
+	NUM_HISTOGRAMS
+};
+
+enum class FORMAT { TABLE, JSON };
+
+// Counters and histograms, kept per thread and added up when read. Updating one is a relaxed load
+// and store to memory that only the calling thread writes, so sites are cheap enough for the hot
+// loops.
+//
+// Counters are always kept, since the dispatcher logs some of them. Histograms are only kept once
+// enable() is called, as some of them need a clock read.
+//
+// Histogram bucket 0 holds the zeros, and bucket i > 0 holds [2^(i-1), 2^i).
+class STATS_MGR
+{
+public:
+	STATS_MGR() = delete;
+	STATS_MGR(const STATS_MGR &) = delete;
+	STATS_MGR(STATS_MGR &&) = delete;
+	STATS_MGR & operator=(const STATS_MGR &) = delete;
+	STATS_MGR & operator=(STATS_MGR &&) = delete;
+
+	static void enable() { m_histograms_enabled = true; }
+	static bool is_enabled() { return m_histograms_enabled; }
+
+	static void add(COUNTER counter, uint64_t amount)
+	{
+		bump(get_thread_block().counters[size_t(counter)], amount);
+	}
+	static void record(HISTOGRAM histogram, uint64_t value, uint64_t num_samples = 1);
+
+	// Sums over all threads. Only exact once nothing updates the stats anymore.
+	static uint64_t get_counter(COUNTER counter);
+	static void dump(std::ostream & os, FORMAT format);
+
+private:
+	static constexpr size_t NUM_BUCKETS = 65;
+
+	struct HISTOGRAM_DATA
+	{
+		std::atomic<uint64_t> num_samples{0};
+		std::atomic<uint64_t> sum{0};
+		std::atomic<uint64_t> max{0};
+		std::atomic<uint64_t> buckets[NUM_BUCKETS] = {};
+	};
+
+	struct THREAD_BLOCK
+	{
+		std::atomic<uint64_t> counters[size_t(COUNTER::NUM_COUNTERS)] = {};
+		HISTOGRAM_DATA histograms[size_t(HISTOGRAM::NUM_HISTOGRAMS)];
+	};
+
+	struct MERGED_HISTOGRAM
+	{
+		uint64_t num_samples = 0;
+		uint64_t sum = 0;
+		uint64_t max = 0;
+		uint64_t buckets[NUM_BUCKETS] = {};
+	};
+
+	static void bump(std::atomic<uint64_t> & value, uint64_t amount)
+	{
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	static THREAD_BLOCK & get_thread_block()
+	{
+		static thread_local THREAD_BLOCK * block = nullptr;
+		if (block == nullptr)
+		{
+			block = register_thread();
+		}
+		return *block;
+	}
+
+	// Blocks belong to STATS_MGR rather than to their threads, so they outlive them.
+	static THREAD_BLOCK * register_thread();
+	static MERGED_HISTOGRAM merge(HISTOGRAM histogram);
+
+	static std::mutex m_mutex;
+	static std::vector<std::unique_ptr<THREAD_BLOCK>> m_blocks;
+	static bool m_histograms_enabled;
+};
+
+// Times a scope into a histogram, if histograms are on
+class SCOPE_TIMER
+{
+public:
+	SCOPE_TIMER() = delete;
+	SCOPE_TIMER(const SCOPE_TIMER &) = delete;
+	SCOPE_TIMER(SCOPE_TIMER &&) = delete;
+	SCOPE_TIMER & operator=(const SCOPE_TIMER &) = delete;
+	SCOPE_TIMER & operator=(SCOPE_TIMER &&) = delete;
+
+	explicit SCOPE_TIMER(HISTOGRAM histogram)
+	: m_histogram(histogram), m_enabled(SCHED_STATS_ENABLED && STATS_MGR::is_enabled())
+	{
+		if (m_enabled)
+		{
+			m_start = CLOCK_TYPE::now();
+		}
+	}
+
+	~SCOPE_TIMER()
+	{
+		if (m_enabled)
+		{
+			STATS_MGR::record(m_histogram,
+				std::chrono::duration_cast<std::chrono::nanoseconds>(CLOCK_TYPE::now() - m_start).count());
+		}
+	}
+
+private:
+	typedef std::chrono::steady_clock CLOCK_TYPE;
+
+	HISTOGRAM m_histogram;
+	bool m_enabled;
+	CLOCK_TYPE::time_point m_start;
+};
+
+} // End namespace STATS
+
+#define SCHED_STAT_ADD(counter, amount) \
+	do \
+	{ \
+		if (SCHED_STATS_ENABLED) \
+		{ \
+			STATS::STATS_MGR::add(STATS::COUNTER::counter, (amount)); \
+		} \
+	} while (false)
+
+#define SCHED_STAT_RECORD(histogram, value) \
+	do \
+	{ \
+		if (SCHED_STATS_ENABLED && STATS::STATS_MGR::is_enabled()) \
+		{ \
+			STATS::STATS_MGR::record(STATS::HISTOGRAM::histogram, (value)); \
+		} \
+	} while (false)
+
+#endif
@@ -0,0 +1,93 @@
+
+#include "thread_pool.hh"
+
+#include <cassert>
+
+namespace THREADS
+{
+
+THREAD_POOL::THREAD_POOL(size_t num_threads)
+{
+	assert(num_threads > 0);
+	for (size_t i = 1; i < num_threads; ++i)
+	{
+		m_threads.emplace_back(&THREAD_POOL::worker_loop, this);
+	}
+}
+
+THREAD_POOL::~THREAD_POOL()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_work_cv.notify_all();
+	for (std::thread & thread: m_threads)
+	{
+		thread.join();
+	}
+}
+
+void THREAD_POOL::parallel_for(size_t num_tasks, const TASK & task)
+{
+	if (m_threads.empty() || num_tasks <= 1)
+	{
+		for (size_t i = 0; i < num_tasks; ++i)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(m_num_busy == 0);
+		m_task = &task;
+		m_num_tasks = num_tasks;
+		m_next_task = 0;
+		m_num_busy = m_threads.size();
+		++m_generation;
+	}
+	m_work_cv.notify_all();
+
+	run_tasks();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done_cv.wait(lock, [this] { return m_num_busy == 0; });
+	m_task = nullptr;
+}
+
+void THREAD_POOL::run_tasks()
+{
+	for (size_t i = m_next_task++; i < m_num_tasks; i = m_next_task++)
+	{
+		(*m_task)(i);
+	}
+}
+
+void THREAD_POOL::worker_loop()
+{
+	size_t seen_generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_work_cv.wait(lock, [this, seen_generation] { return m_stopping || m_generation != seen_generation; });
+			if (m_stopping)
+			{
+				return;
+			}
+			seen_generation = m_generation;
+		}
+
+		run_tasks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_num_busy;
+		}
+		m_done_cv.notify_one();
+	}
+}
+
+} // End namespace THREADS
@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace THREADS
+{
+
+// Fixed set of threads that run parallel_for() loops. The calling thread takes part in every loop,
+// so a pool of N threads spawns N - 1 of them.
+class THREAD_POOL
+{
+public:
+	typedef std::function<void(size_t)> TASK;
+
+	THREAD_POOL() = delete;
+	THREAD_POOL(const THREAD_POOL &) = delete;
+	THREAD_POOL(THREAD_POOL &&) = delete;
+	THREAD_POOL & operator=(const THREAD_POOL &) = delete;
+	THREAD_POOL & operator=(THREAD_POOL &&) = delete;
+
+	explicit THREAD_POOL(size_t num_threads);
+	~THREAD_POOL();
+
+	size_t size() const { return m_threads.size() + 1; }
+
+	// Calls task(i) for every i in [0, num_tasks), in no particular order and on any thread. Returns
+	// once all of them are done.
+	void parallel_for(size_t num_tasks, const TASK & task);
+
+private:
+	void worker_loop();
+	void run_tasks();
+
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_work_cv;
+	std::condition_variable m_done_cv;
+	size_t m_generation = 0;
+	size_t m_num_busy = 0;
+	bool m_stopping = false;
+
+	const TASK * m_task = nullptr;
+	size_t m_num_tasks = 0;
+	std::atomic<size_t> m_next_task{0};
+};
+
+} // End namespace THREADS
+
+#endif
@@ -0,0 +1,400 @@
+// Native counterpart of input/gen.py, for inputs far larger than the python script can produce.
+//
+// The defaults and the ranges of every field are the same as generate_jobs(), minus python's random
+// sequence. On top of those, arrivals can come in bursts, subtask counts can follow a heavy-tailed
+// (Pareto) law, and priorities can be skewed towards the low end.
+//
+// Each job draws from its own random stream, keyed by the seed and the job index, so the output only
+// depends on the options. Jobs are written first, then workers, one line each.
+//
+// Usage: gen_input [options] (see --help)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+struct GEN_OPTIONS
+{
+	uint64_t seed = 1;
+	uint64_t num_jobs = 200;
+	uint64_t max_tasks = 200;
+	uint64_t max_task_time = 50;
+	uint64_t max_can_begin_time = 800;
+	uint64_t max_priority = 20;
+	uint64_t task_time = 0; // Fixed value if non zero, like the keyword arguments of generate_jobs()
+	uint64_t can_begin_time = UINT64_MAX; // Fixed value unless UINT64_MAX
+	uint64_t priority = 0; // Fixed value if non zero
+	uint64_t num_workers = 0; // Drawn from the worker ratio range if zero
+	double min_worker_ratio = 0.25;
+	double max_worker_ratio = 0.5;
+	uint64_t num_bursts = 0; // Arrivals are uniform if zero
+	uint64_t burst_width = 10;
+	double tasks_pareto_alpha = 0; // Subtask counts are uniform if zero
+	double priority_skew = 1; // Exponent on a uniform draw; above 1 favors low priorities
+	std::string output_path; // stdout if empty
+};
+
+// splitmix64. Streams seeded with different keys are independent for all practical purposes.
+class RANDOM
+{
+public:
+	RANDOM(uint64_t seed, uint64_t key) : m_state(seed * 0x9e3779b97f4a7c15ull ^ (key + 0x632be59bd9b4e019ull))
+	{
+		next();
+	}
+
+	uint64_t next()
+	{
+		uint64_t z = (m_state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// In [0, bound). Bound must be positive.
+	uint64_t below(uint64_t bound)
+	{
+		return next() % bound;
+	}
+
+	// In [0, 1), with 53 random bits
+	double uniform()
+	{
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+private:
+	uint64_t m_state;
+};
+
+// Keys of the streams that aren't per job. Job streams use the job index.
+const uint64_t WORKER_COUNT_KEY = UINT64_MAX;
+const uint64_t BURST_KEY = UINT64_MAX - 1;
+
+struct GEN_JOB
+{
+	uint64_t num_tasks;
+	uint64_t task_time;
+	uint64_t can_begin_time;
+	uint64_t priority;
+};
+
+class GENERATOR
+{
+public:
+	explicit GENERATOR(const GEN_OPTIONS & options) : m_options(options)
+	{
+		RANDOM random(options.seed, BURST_KEY);
+		for (uint64_t i = 0; i < options.num_bursts; ++i)
+		{
+			m_burst_starts.push_back(random.below(options.max_can_begin_time));
+		}
+	}
+
+	// Can begin time first, so that the normalization pass doesn't need the rest
+	uint64_t draw_can_begin_time(RANDOM & random) const
+	{
+		if (m_options.can_begin_time != UINT64_MAX)
+		{
+			return m_options.can_begin_time;
+		}
+		if (m_burst_starts.empty())
+		{
+			return random.below(m_options.max_can_begin_time);
+		}
+		uint64_t burst_start = m_burst_starts[random.below(m_burst_starts.size())];
+		return std::min(burst_start + random.below(m_options.burst_width), m_options.max_can_begin_time - 1);
+	}
+
+	GEN_JOB draw_job(uint64_t job_idx) const
+	{
+		RANDOM random(m_options.seed, job_idx);
+		GEN_JOB job;
+		job.can_begin_time = draw_can_begin_time(random);
+
+		if (m_options.tasks_pareto_alpha > 0)
+		{
+			// Inverse transform of a Pareto law with a minimum of 1
+			double tail = std::pow(1.0 - random.uniform(), -1.0 / m_options.tasks_pareto_alpha);
+			job.num_tasks = (tail >= m_options.max_tasks) ? m_options.max_tasks : uint64_t(tail);
+		}
+		else
+		{
+			job.num_tasks = random.below(m_options.max_tasks) + 1;
+		}
+
+		job.task_time = m_options.task_time ? m_options.task_time : random.below(m_options.max_task_time) + 1;
+
+		if (m_options.priority)
+		{
+			job.priority = m_options.priority;
+		}
+		else
+		{
+			double draw = std::pow(random.uniform(), m_options.priority_skew);
+			job.priority = 1 + std::min(uint64_t(draw * (m_options.max_priority - 1)), m_options.max_priority - 2);
+		}
+		return job;
+	}
+
+	// gen.py shifts every can begin time so that the earliest one is 0.
+	uint64_t find_min_can_begin_time() const
+	{
+		uint64_t min_can_begin_time = UINT64_MAX;
+		for (uint64_t job_idx = 0; job_idx < m_options.num_jobs; ++job_idx)
+		{
+			RANDOM random(m_options.seed, job_idx);
+			min_can_begin_time = std::min(min_can_begin_time, draw_can_begin_time(random));
+		}
+		return min_can_begin_time;
+	}
+
+	uint64_t get_num_workers() const
+	{
+		if (m_options.num_workers)
+		{
+			return m_options.num_workers;
+		}
+		RANDOM random(m_options.seed, WORKER_COUNT_KEY);
+		double ratio = m_options.min_worker_ratio +
+			(m_options.max_worker_ratio - m_options.min_worker_ratio) * random.uniform();
+		return std::max<uint64_t>(1, uint64_t(m_options.num_jobs * ratio));
+	}
+
+private:
+	const GEN_OPTIONS & m_options;
+	std::vector<uint64_t> m_burst_starts;
+};
+
+// Buffered writer that formats numbers itself, which is most of the work
+class LINE_WRITER
+{
+public:
+	static const size_t BUFFER_SIZE = 1 << 20;
+
+	explicit LINE_WRITER(std::FILE * file) : m_file(file) { m_buffer.reserve(BUFFER_SIZE + 256); }
+	~LINE_WRITER() { flush(); }
+
+	void put(const char * text, size_t length)
+	{
+		m_buffer.insert(m_buffer.end(), text, text + length);
+	}
+
+	void put(char c)
+	{
+		m_buffer.push_back(c);
+	}
+
+	void put_decimal(uint64_t number)
+	{
+		char digits[20];
+		size_t num_digits = 0;
+		do
+		{
+			digits[num_digits++] = '0' + number % 10;
+			number /= 10;
+		} while (number != 0);
+		while (num_digits > 0)
+		{
+			m_buffer.push_back(digits[--num_digits]);
+		}
+	}
+
+	// Lines are short, so it's enough to check once per line
+	void end_line()
+	{
+		m_buffer.push_back('\n');
+		if (m_buffer.size() >= BUFFER_SIZE)
+		{
+			flush();
+		}
+	}
+
+	void flush()
+	{
+		if (!m_buffer.empty() && std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+		{
+			std::cerr << "Error: Can't write the output\n";
+			exit(1);
+		}
+		m_buffer.clear();
+	}
+
+private:
+	std::FILE * m_file;
+	std::vector<char> m_buffer;
+};
+
+void l_write_problem(const GEN_OPTIONS & options, std::FILE * file)
+{
+	GENERATOR generator(options);
+	const uint64_t min_can_begin_time = generator.find_min_can_begin_time();
+	LINE_WRITER writer(file);
+
+	for (uint64_t job_idx = 0; job_idx < options.num_jobs; ++job_idx)
+	{
+		GEN_JOB job = generator.draw_job(job_idx);
+		writer.put("job job_", 8);
+		writer.put_decimal(job_idx);
+		writer.put(' ');
+		writer.put_decimal(job.num_tasks);
+		writer.put(' ');
+		writer.put_decimal(job.task_time);
+		writer.put(' ');
+		writer.put_decimal(job.can_begin_time - min_can_begin_time);
+		writer.put(' ');
+		writer.put_decimal(job.priority);
+		writer.end_line();
+	}
+
+	const uint64_t num_workers = generator.get_num_workers();
+	for (uint64_t worker_idx = 0; worker_idx < num_workers; ++worker_idx)
+	{
+		writer.put("worker android_", 15);
+		writer.put_decimal(worker_idx);
+		writer.end_line();
+	}
+}
+
+void l_print_usage(const char * exec_name)
+{
+	GEN_OPTIONS defaults;
+	std::cerr << "Usage: " << exec_name << " [options]\n"
+		<< "  --seed N               Seed (default " << defaults.seed << ")\n"
+		<< "  --num-jobs N           Number of jobs (default " << defaults.num_jobs << ")\n"
+		<< "  --max-tasks N          Subtasks per job are in [1, N] (default " << defaults.max_tasks << ")\n"
+		<< "  --max-task-time N      Subtask durations are in [1, N] (default " << defaults.max_task_time << ")\n"
+		<< "  --max-can-begin N      Earliest start times are in [0, N) (default " << defaults.max_can_begin_time << ")\n"
+		<< "  --max-priority N       Priorities are in [1, N) (default " << defaults.max_priority << ")\n"
+		<< "  --task-time N          Every subtask takes N\n"
+		<< "  --can-begin N          Every job can begin at N\n"
+		<< "  --priority N           Every job has priority N\n"
+		<< "  --num-workers N        Number of workers (default: a ratio of the number of jobs)\n"
+		<< "  --worker-ratio LO HI   Workers per job, drawn from [LO, HI) (default "
+		<< defaults.min_worker_ratio << " " << defaults.max_worker_ratio << ")\n"
+		<< "  --bursts N             Jobs arrive in N bursts instead of uniformly\n"
+		<< "  --burst-width N        Spread of the arrivals within a burst (default " << defaults.burst_width << ")\n"
+		<< "  --tasks-pareto ALPHA   Heavy-tailed subtask counts, lower ALPHA for a heavier tail\n"
+		<< "  --priority-skew S      Priority is drawn from U^S, so S > 1 favors low priorities (default "
+		<< defaults.priority_skew << ")\n"
+		<< "  --output FILE          Write to FILE instead of stdout\n";
+}
+
+[[noreturn]] void l_bad_usage(const char * exec_name, const std::string & message)
+{
+	std::cerr << "Error: " << message << "\n";
+	l_print_usage(exec_name);
+	exit(1);
+}
+
+uint64_t l_parse_number(const char * exec_name, const std::string & option, const char * value, uint64_t min_number)
+{
+	char * end = nullptr;
+	unsigned long long number = (value == nullptr) ? 0 : std::strtoull(value, &end, 10);
+	if (value == nullptr || end == value || *end != '\0' || number < min_number)
+	{
+		l_bad_usage(exec_name, "Expected a number of at least " + std::to_string(min_number) + " for " + option);
+	}
+	return number;
+}
+
+double l_parse_fraction(const char * exec_name, const std::string & option, const char * value)
+{
+	char * end = nullptr;
+	double number = (value == nullptr) ? 0 : std::strtod(value, &end);
+	if (value == nullptr || end == value || *end != '\0' || !(number > 0))
+	{
+		l_bad_usage(exec_name, "Expected a positive number for " + option);
+	}
+	return number;
+}
+
+GEN_OPTIONS l_parse_options(int argc, char ** argv)
+{
+	const char * exec_name = argv[0];
+	GEN_OPTIONS options;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option(argv[i]);
+		const char * value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		if (option == "--help")
+		{
+			l_print_usage(exec_name);
+			exit(0);
+		}
+		else if (option == "--seed") { options.seed = l_parse_number(exec_name, option, value, 0); }
+		else if (option == "--num-jobs") { options.num_jobs = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--max-tasks") { options.max_tasks = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--max-task-time") { options.max_task_time = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--max-can-begin") { options.max_can_begin_time = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--max-priority") { options.max_priority = l_parse_number(exec_name, option, value, 2); }
+		else if (option == "--task-time") { options.task_time = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--can-begin") { options.can_begin_time = l_parse_number(exec_name, option, value, 0); }
+		else if (option == "--priority") { options.priority = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--num-workers") { options.num_workers = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--worker-ratio")
+		{
+			options.min_worker_ratio = l_parse_fraction(exec_name, option, value);
+			options.max_worker_ratio = l_parse_fraction(exec_name, option, (i + 2 < argc) ? argv[i + 2] : nullptr);
+			if (options.max_worker_ratio < options.min_worker_ratio)
+			{
+				l_bad_usage(exec_name, "The worker ratio range is empty");
+			}
+			++i;
+		}
+		else if (option == "--bursts") { options.num_bursts = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--burst-width") { options.burst_width = l_parse_number(exec_name, option, value, 1); }
+		else if (option == "--tasks-pareto") { options.tasks_pareto_alpha = l_parse_fraction(exec_name, option, value); }
+		else if (option == "--priority-skew") { options.priority_skew = l_parse_fraction(exec_name, option, value); }
+		else if (option == "--output")
+		{
+			if (value == nullptr)
+			{
+				l_bad_usage(exec_name, "Missing value for " + option);
+			}
+			options.output_path = value;
+		}
+		else
+		{
+			l_bad_usage(exec_name, "Unknown option " + option);
+		}
+		++i;
+	}
+	return options;
+}
+
+} // End anonymous namespace
+
+int main(int argc, char ** argv)
+{
+	GEN_OPTIONS options = l_parse_options(argc, argv);
+
+	std::FILE * file = stdout;
+	if (!options.output_path.empty())
+	{
+		file = std::fopen(options.output_path.c_str(), "wb");
+		if (file == nullptr)
+		{
+			std::cerr << "Error: Can't open " << options.output_path << " for writing\n";
+			return 1;
+		}
+	}
+
+	l_write_problem(options, file);
+
+	if (std::fclose(file) != 0)
+	{
+		std::cerr << "Error: Can't write the output\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+
+#include "trace.hh"
+
+#include <cassert>
+
+namespace TRACE
+{
+
+TRACE_RING * TRACE_RING::m_inst = nullptr;
+
+namespace
+{
+
+const char * l_get_event_type_name(EVENT_TYPE type)
+{
+	switch (type)
+	{
+	case EVENT_TYPE::DISPATCH: return "DISPATCH job=%0 tried=%1 picked_attempt=%2";
+	case EVENT_TYPE::PROJECTION: return "PROJECTION job=%0 eta=%1 cached=%2";
+	}
+	return "UNKNOWN %0 %1 %2";
+}
+
+// Expands %0..%2 in the format with the event's arguments
+void l_print_event(std::ostream & os, const EVENT & event)
+{
+	os << event.seq << " " << event.time_ns << "ns ";
+	for (const char * iter = l_get_event_type_name(event.type); *iter != '\0'; ++iter)
+	{
+		if (iter[0] == '%' && iter[1] >= '0' && iter[1] <= '2')
+		{
+			os << event.args[iter[1] - '0'];
+			++iter;
+		}
+		else
+		{
+			os << *iter;
+		}
+	}
+	os << '\n';
+}
+
+} // End anonymous namespace
+
+TRACE_RING::TRACE_RING(size_t capacity)
+: m_start(CLOCK_TYPE::now())
+{
+	size_t rounded_capacity = 1;
+	while (rounded_capacity < capacity)
+	{
+		rounded_capacity <<= 1;
+	}
+	m_events.resize(rounded_capacity);
+	m_mask = rounded_capacity - 1;
+}
+
+void TRACE_RING::enable(size_t capacity)
+{
+	assert(m_inst == nullptr);
+	assert(capacity > 0);
+	m_inst = new TRACE_RING(capacity);
+}
+
+void TRACE_RING::record(EVENT_TYPE type, uint64_t arg0, uint64_t arg1, uint64_t arg2)
+{
+	assert(m_inst != nullptr);
+	uint64_t seq = m_inst->m_next_seq.fetch_add(1, std::memory_order_relaxed);
+	EVENT & event = m_inst->m_events[seq & m_inst->m_mask];
+	event.seq = seq;
+	event.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(CLOCK_TYPE::now() - m_inst->m_start).count();
+	event.type = type;
+	event.args[0] = arg0;
+	event.args[1] = arg1;
+	event.args[2] = arg2;
+}
+
+void TRACE_RING::dump(std::ostream & os)
+{
+	if (m_inst == nullptr)
+	{
+		return;
+	}
+	uint64_t num_recorded = m_inst->m_next_seq.load();
+	uint64_t capacity = m_inst->m_events.size();
+	uint64_t first_seq = (num_recorded > capacity) ? num_recorded - capacity : 0;
+	os << "Trace: " << num_recorded << " events recorded, last " << (num_recorded - first_seq) << " kept\n";
+	for (uint64_t seq = first_seq; seq < num_recorded; ++seq)
+	{
+		l_print_event(os, m_inst->m_events[seq & m_inst->m_mask]);
+	}
+}
+
+} // End namespace TRACE
@@ -0,0 +1,75 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Trace sites are compiled out entirely with "make TRACE=0".
+#ifndef SCHED_TRACE_ENABLED
+#define SCHED_TRACE_ENABLED 1
+#endif
+
+namespace TRACE
+{
+
+enum class EVENT_TYPE : uint32_t
+{
+	DISPATCH = 1,   // job index, number of jobs tried, picked attempt
+	PROJECTION = 2  // job index, projected completion time, 1 if it came from the ETA cache
+};
+
+struct EVENT
+{
+	uint64_t seq;
+	uint64_t time_ns; // Since the ring was enabled
+	EVENT_TYPE type;
+	uint32_t padding;
+	uint64_t args[3];
+};
+
+// Fixed size in-memory ring of binary events. Recording is lock-free: each event claims a slot with
+// one atomic increment, and the oldest events get overwritten once the ring is full. The ring is
+// only meant to be dumped once nothing records anymore.
+class TRACE_RING
+{
+public:
+	TRACE_RING() = delete;
+	TRACE_RING(const TRACE_RING &) = delete;
+	TRACE_RING(TRACE_RING &&) = delete;
+	TRACE_RING & operator=(const TRACE_RING &) = delete;
+	TRACE_RING & operator=(TRACE_RING &&) = delete;
+
+	static void enable(size_t capacity); // Rounded up to a power of two
+	static bool is_enabled() { return m_inst != nullptr; }
+	static void record(EVENT_TYPE type, uint64_t arg0, uint64_t arg1, uint64_t arg2);
+	static void dump(std::ostream & os); // Oldest first, one line per event
+
+private:
+	typedef std::chrono::steady_clock CLOCK_TYPE;
+
+	explicit TRACE_RING(size_t capacity);
+	~TRACE_RING() = default;
+
+	std::vector<EVENT> m_events;
+	uint64_t m_mask;
+	std::atomic<uint64_t> m_next_seq{0};
+	CLOCK_TYPE::time_point m_start;
+
+	static TRACE_RING * m_inst;
+};
+
+} // End namespace TRACE
+
+#define SCHED_TRACE(type, arg0, arg1, arg2) \
+	do \
+	{ \
+		if (SCHED_TRACE_ENABLED && TRACE::TRACE_RING::is_enabled()) \
+		{ \
+			TRACE::TRACE_RING::record(TRACE::EVENT_TYPE::type, (arg0), (arg1), (arg2)); \
+		} \
+	} while (false)
+
+#endif
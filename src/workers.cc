@@ -1,97 +1,191 @@
 
 #include "workers.hh"
+#include "context.hh"
+#include "cost_engine.hh"
+#include "log.hh"
+#include "trace.hh"
+#include "stats.hh"
 
 #include <string>
 #include <iostream>
 #include <cassert>
 #include <algorithm>
+#include <iterator>
+#include <functional>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace WORKERS
 {
 
-WORKER_MGR * WORKER_MGR::m_inst = nullptr;
+constexpr JOBS::TIME WORKER_MGR::NO_SYMMETRY_CLASS;
 
 namespace
 {
 
 typedef std::vector<WORKER::SUBTASK_CITER> SUBMISSION_LIST;
 
+// Completion time of the next slot a worker could offer. The earliest comes first, then the lowest
+// worker index. A symmetry class goes in as its lowest member, and the next one is pushed when that
+// one is popped: the members come out in the same order as if they had been pushed one by one.
+struct CANDIDATE
+{
+	JOBS::TIME complete_time;
+	WORKER::WORKER_IDX worker_idx;
+	const std::vector<WORKER::WORKER_IDX> * peers; // The rest of the class, or nullptr
+	size_t next_peer;
+
+	bool operator>(const CANDIDATE & other) const
+	{
+		return complete_time != other.complete_time ?
+			complete_time > other.complete_time : worker_idx > other.worker_idx;
+	}
+};
+typedef std::vector<CANDIDATE> CANDIDATE_HEAP; // Min-heap, see std::push_heap
+
 
-JOBS::TIME l_get_job_completion_time(const JOBS::JOB_ENTRY & job, JOBS::TIME start_time)
+// Completion time of the subtask before subtask_iter, or genesis if there's none.
+JOBS::TIME l_get_prev_complete_time(const WORKER::SUBTASK_CONTAINER & exec_hist, WORKER::SUBTASK_CITER subtask_iter)
 {
-	assert(job.get_subtask_duration() > 0);
-	return start_time + job.get_subtask_duration();
+	return (subtask_iter == exec_hist.cbegin()) ? 0 : std::prev(subtask_iter)->get_complete_time();
+}
+
+// Start time of the subtask after subtask_iter, or infinity if there's none.
+JOBS::TIME l_get_next_start_time(const WORKER::SUBTASK_CONTAINER & exec_hist, WORKER::SUBTASK_CITER subtask_iter)
+{
+	auto next_iter = std::next(subtask_iter);
+	return (next_iter == exec_hist.cend()) ? WORKER::HOLES::INF_TIME : next_iter->get_start_time();
 }
 
 std::pair<WORKER::SUBTASK_CITER, JOBS::TIME>
 find_earliest_subtask_insertion_slot_and_start_time(
-	const JOBS::JOB_ENTRY & job, const WORKER::SUBTASK_CONTAINER & exec_hist)
+	const JOBS::JOB_ENTRY & job, const WORKER::SUBTASK_CONTAINER & exec_hist, const WORKER::HOLES & holes,
+	JOBS::TIME not_before = 0)
 {
-	JOBS::TIME prev_complete_time = 0;
-	const JOBS::TIME earliest_start = job.get_earliest_start_time();
+	const JOBS::TIME earliest_start = std::max(job.get_earliest_start_time(), not_before);
 
 	// Find the right hole of right size where the job should be inserted.
-	for (auto iter = exec_hist.cbegin(); iter != exec_hist.cend(); ++iter)
-	{
-		assert(iter->get_start_time() >= prev_complete_time);
+	size_t num_holes_visited = 0;
+	auto hole_time_pair = holes.find_earliest_fit(earliest_start, job.get_subtask_duration(),
+		(SCHED_STATS_ENABLED && STATS::STATS_MGR::is_enabled()) ? &num_holes_visited : nullptr);
+	SCHED_STAT_RECORD(HOLES_VISITED_PER_SLOT_SEARCH, num_holes_visited);
+	const WORKER::HOLES::HOLE * hole = hole_time_pair.first;
 
-		JOBS::TIME hole_end = iter->get_start_time();
-		JOBS::TIME clamped_hole_start = std::max(prev_complete_time, earliest_start);
+	// The trailing hole is unbounded, so something always fits.
+	assert(hole != nullptr);
 
-		prev_complete_time = iter->get_complete_time();
+	if (hole->is_tail())
+	{
+		// No hole works. Put it at the end of list.
+		return std::make_pair(exec_hist.cend(), hole_time_pair.second);
+	}
+	return std::make_pair(hole->payload, hole_time_pair.second);
+}
 
-		if (clamped_hole_start > hole_end)
-		{
-			// Clamped by earliest_start that's after the hole
-			continue;
-		}
+struct WORKER_TIMES
+{
+	size_t num_workers;
+	const JOBS::TIME * tails;
+	const JOBS::TIME * last_hole_ends;
+	const JOBS::TIME * max_hole_lengths;
+};
 
-		JOBS::TIME hole_size = hole_end - clamped_hole_start;
+// For each worker, the completion time of a subtask of the given duration put after its last
+// subtask, but not before earliest_start. A hole can only take the subtask if it's long enough and
+// ends at earliest_start + duration or later, so a worker with such a hole gets 0 instead: it needs
+// a real slot search.
+void l_project_tails_scalar(const WORKER_TIMES & workers, size_t begin, JOBS::TIME earliest_start,
+	JOBS::TIME duration, JOBS::TIME * complete_times)
+{
+	const JOBS::TIME earliest_complete = earliest_start + duration;
+	for (size_t i = begin; i < workers.num_workers; ++i)
+	{
+		bool needs_search = workers.last_hole_ends[i] >= earliest_complete && workers.max_hole_lengths[i] >= duration;
+		complete_times[i] = needs_search ? 0 : std::max(workers.tails[i], earliest_start) + duration;
+	}
+}
 
-		// Calculate the "would-be" start and end time for new job
-		if (job.get_subtask_duration() <= hole_size)// can fit into the hole
-		{
-			// This is the right hole
-			return std::make_pair(iter, clamped_hole_start);
-		}
+#if defined(__x86_64__)
+// Same, four workers at a time. Times stay far below 2^63, so signed compares do.
+__attribute__((target("avx2")))
+void l_project_tails_avx2(const WORKER_TIMES & workers, size_t begin, JOBS::TIME earliest_start,
+	JOBS::TIME duration, JOBS::TIME * complete_times)
+{
+	const __m256i earliest_starts = _mm256_set1_epi64x(earliest_start);
+	const __m256i durations = _mm256_set1_epi64x(duration);
+	const __m256i latest_useless_ends = _mm256_set1_epi64x(earliest_start + duration - 1);
+	const __m256i longest_useless_lengths = _mm256_set1_epi64x(duration - 1);
+	size_t i = begin;
+	for (; i + 4 <= workers.num_workers; i += 4)
+	{
+		__m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(workers.tails + i));
+		__m256i last_hole_end = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(workers.last_hole_ends + i));
+		__m256i max_hole_length = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(workers.max_hole_lengths + i));
+		__m256i start = _mm256_blendv_epi8(earliest_starts, tail, _mm256_cmpgt_epi64(tail, earliest_starts));
+		__m256i needs_search = _mm256_and_si256(_mm256_cmpgt_epi64(last_hole_end, latest_useless_ends),
+			_mm256_cmpgt_epi64(max_hole_length, longest_useless_lengths));
+		__m256i complete = _mm256_andnot_si256(needs_search, _mm256_add_epi64(start, durations));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(complete_times + i), complete);
 	}
+	l_project_tails_scalar(workers, i, earliest_start, duration, complete_times);
+}
+#endif
+
+typedef void (*PROJECT_TAILS_FUNC)(const WORKER_TIMES &, size_t, JOBS::TIME, JOBS::TIME, JOBS::TIME *);
 
-	// No hole works. Put it at the end of list.
-	return std::make_pair(exec_hist.cend(), std::max(earliest_start, prev_complete_time));
+// Picked once, by what the CPU running the binary supports
+PROJECT_TAILS_FUNC l_get_project_tails()
+{
+#if defined(__x86_64__)
+	static const PROJECT_TAILS_FUNC project_tails =
+		__builtin_cpu_supports("avx2") ? l_project_tails_avx2 : l_project_tails_scalar;
+	return project_tails;
+#else
+	return l_project_tails_scalar;
+#endif
 }
 
 
 } // End anonymous namespace
 
-SUBTASK::SUBTASK(const JOBS::JOB_ENTRY & job, const WORKER & worker, JOBS::TIME start_time)
-: m_job(job), m_worker(worker), m_start_time(start_time)
+SUBTASK_RUN::SUBTASK_RUN(const JOBS::JOB_ENTRY & job, const WORKER & worker, JOBS::TIME start_time, size_t num_subtasks)
+: m_start_time(start_time), m_job_idx(job.get_index()), m_worker_idx(worker.get_index()), m_num_subtasks(num_subtasks)
 {
-	assert(m_start_time >= m_job.get_earliest_start_time());
-	assert(m_job.get_subtask_duration() > 0);
+	assert(m_start_time >= job.get_earliest_start_time());
+	assert(job.get_subtask_duration() > 0);
+	assert(num_subtasks > 0 && num_subtasks <= job.get_num_subtasks());
 }
 
-JOBS::TIME SUBTASK::get_start_time() const
+JOBS::TIME SUBTASK_RUN::get_start_time() const
 {
 	return m_start_time;
 }
 
-JOBS::TIME SUBTASK::get_complete_time() const
+JOBS::TIME SUBTASK_RUN::get_complete_time() const
+{
+	return get_subtask_start_time(m_num_subtasks);
+}
+
+JOBS::TIME SUBTASK_RUN::get_subtask_start_time(size_t subtask_in_run) const
 {
-	return l_get_job_completion_time(m_job, m_start_time);
+	return m_start_time + subtask_in_run * get_job().get_subtask_duration();
 }
 
-const JOBS::JOB_ENTRY & SUBTASK::get_job() const
+JOBS::JOB_ENTRY SUBTASK_RUN::get_job() const
 {
-	return m_job;
+	return JOBS::JOB_POOL::get_inst()[m_job_idx];
 }
 
-std::string SUBTASK::to_string() const
+std::string SUBTASK_RUN::to_string(size_t subtask_in_run) const
 {
-	std::string retval = m_job.to_string();
+	assert(subtask_in_run < m_num_subtasks);
+	std::string retval = get_job().to_string();
 	retval += ": ";
-	retval += std::to_string(get_start_time());
+	retval += std::to_string(get_subtask_start_time(subtask_in_run));
 	retval += " ";
-	retval += std::to_string(get_complete_time());
+	retval += std::to_string(get_subtask_start_time(subtask_in_run + 1));
 	return retval;
 }
 
@@ -105,18 +199,56 @@ WORKER::SUBTASK_CITER WORKER::cend() const
 	return m_exec_hist.cend();
 }
 
-WORKER::SUBTASK_ITER WORKER::submit_subtask(const JOBS::JOB_ENTRY & job)
+JOBS::TIME WORKER::submit_subtask(const JOBS::JOB_ENTRY & job, SUBTASK_CITER * run_iter_out)
 {
-	auto iter_time_pair = find_earliest_subtask_insertion_slot_and_start_time(job, m_exec_hist);
-	return m_exec_hist.emplace(iter_time_pair.first, job, *this, iter_time_pair.second);
+	auto iter_time_pair = find_earliest_subtask_insertion_slot_and_start_time(job, m_exec_hist, m_holes);
+	SUBTASK_ITER next_iter = m_exec_hist.erase(iter_time_pair.first, iter_time_pair.first); // Non-const
+	const JOBS::TIME start_time = iter_time_pair.second;
+
+	const JOBS::TIME hole_start = l_get_prev_complete_time(m_exec_hist, next_iter);
+	const JOBS::TIME hole_end = (next_iter == m_exec_hist.end()) ? HOLES::INF_TIME : next_iter->get_start_time();
+	m_holes.erase(hole_start);
+
+	SUBTASK_ITER run_iter;
+	if (hole_start == start_time && next_iter != m_exec_hist.begin() &&
+		std::prev(next_iter)->get_job_index() == job.get_index())
+	{
+		// Right after a subtask of the same job: grow its run.
+		run_iter = std::prev(next_iter);
+		++run_iter->m_num_subtasks;
+	}
+	else
+	{
+		// The new subtask splits the hole it went into.
+		run_iter = m_exec_hist.emplace(next_iter, job, *this, start_time);
+		if (hole_start < start_time)
+		{
+			m_holes.insert(hole_start, start_time, run_iter);
+		}
+	}
+	if (run_iter->get_complete_time() < hole_end)
+	{
+		m_holes.insert(run_iter->get_complete_time(), hole_end, next_iter);
+	}
+	if (run_iter_out != nullptr)
+	{
+		*run_iter_out = run_iter;
+	}
+	return start_time;
 }
 
 // Ruturn a copy of how the subtask would look like (start and complete time) if it were submitted,
 // but don't really change the execution history
-SUBTASK WORKER::try_submit_subtask(const JOBS::JOB_ENTRY & job) const
+SUBTASK_RUN WORKER::try_submit_subtask(const JOBS::JOB_ENTRY & job) const
 {
-	auto iter_time_pair = find_earliest_subtask_insertion_slot_and_start_time(job, m_exec_hist);
-	return SUBTASK(job, *this, iter_time_pair.second);
+	auto iter_time_pair = find_earliest_subtask_insertion_slot_and_start_time(job, m_exec_hist, m_holes);
+	return SUBTASK_RUN(job, *this, iter_time_pair.second);
+}
+
+// Same slot search as try_submit_subtask, but the subtask may not start before not_before either.
+JOBS::TIME WORKER::get_earliest_subtask_start_time(const JOBS::JOB_ENTRY & job, JOBS::TIME not_before) const
+{
+	return find_earliest_subtask_insertion_slot_and_start_time(job, m_exec_hist, m_holes, not_before).second;
 }
 
 bool WORKER::execution_history_is_legal() const
@@ -124,11 +256,15 @@ bool WORKER::execution_history_is_legal() const
 	JOBS::TIME prev_complete_time = 0;
 	for (const auto & entry: m_exec_hist)
 	{
-		if (entry.get_start_time() < prev_complete_time ||
+		// Subtasks within a run can't overlap, so checking the run boundaries is enough.
+		if (entry.get_num_subtasks() == 0 ||
+			entry.get_num_subtasks() > entry.get_job().get_num_subtasks() ||
+			entry.get_start_time() < prev_complete_time ||
 			entry.get_start_time() < entry.get_job().get_earliest_start_time())
 		{
 			return false;
 		}
+		prev_complete_time = entry.get_complete_time();
 	}
 	return true;
 }
@@ -141,17 +277,21 @@ WORKER::WORKER_IDX WORKER::get_index() const
 std::ostream & operator<<(std::ostream & os, const WORKER & worker)
 {
 	os << "Worker #" << worker.m_idx << " " << worker.get_name() << " execution history: \n";
-	for (const SUBTASK & hist_entry: worker.m_exec_hist)
+	for (const SUBTASK_RUN & run: worker.m_exec_hist)
 	{
-		os << "  " << hist_entry.to_string() << std::endl;
+		for (size_t i = 0; i < run.get_num_subtasks(); ++i)
+		{
+			os << "  " << run.to_string(i) << std::endl;
+		}
 	}
 	return os;
 }
 
-WORKER::WORKER(WORKER_NAME && name, WORKER_IDX idx)
-: m_name(std::move(name)), m_idx(idx)
+WORKER::WORKER(WORKER_NAME && name, WORKER_IDX idx, NODE_POOL & history_node_pool)
+: m_name(std::move(name)), m_idx(idx), m_exec_hist(NODE_ALLOCATOR<SUBTASK_RUN>(history_node_pool))
 {
-
+	// A fresh worker is idle from genesis on.
+	m_holes.insert(0, HOLES::INF_TIME, m_exec_hist.cend());
 }
 
 const WORKER_NAME & WORKER::get_name() const
@@ -159,90 +299,542 @@ const WORKER_NAME & WORKER::get_name() const
 	return m_name;
 }
 
-void WORKER::remove_subtask(SUBTASK_ITER subtask_iter)
+const WORKER::SUBTASK_CONTAINER & WORKER::get_history() const
+{
+	return m_exec_hist;
+}
+
+const WORKER::HOLES & WORKER::get_holes() const
+{
+	return m_holes;
+}
+
+JOBS::TIME WORKER::get_tail_start_time() const
 {
-	m_exec_hist.erase(subtask_iter);
+	return m_exec_hist.empty() ? 0 : m_exec_hist.back().get_complete_time();
+}
+
+JOBS::TIME WORKER::get_last_hole_end() const
+{
+	const HOLES::HOLE * hole = m_holes.find_last_before(get_tail_start_time());
+	return (hole == nullptr) ? 0 : hole->end;
+}
+
+JOBS::TIME WORKER::get_max_hole_length() const
+{
+	return m_holes.get_max_length_before(get_tail_start_time());
+}
+
+// Takes one subtask out of a run, which may split it in two.
+void WORKER::remove_subtask(SUBTASK_ITER run_iter, size_t subtask_in_run)
+{
+	assert(subtask_in_run < run_iter->get_num_subtasks());
+	const size_t num_before = subtask_in_run;
+	const size_t num_after = run_iter->get_num_subtasks() - subtask_in_run - 1;
+	const JOBS::TIME start_time = run_iter->get_subtask_start_time(subtask_in_run);
+	const JOBS::TIME complete_time = run_iter->get_subtask_start_time(subtask_in_run + 1);
+
+	// The freed time merges with the holes next to it, if the subtask is at either end of the run.
+	JOBS::TIME hole_start = start_time;
+	JOBS::TIME hole_end = complete_time;
+	if (num_before == 0)
+	{
+		hole_start = l_get_prev_complete_time(m_exec_hist, run_iter);
+		if (hole_start < start_time)
+		{
+			m_holes.erase(hole_start);
+		}
+	}
+	if (num_after == 0)
+	{
+		hole_end = l_get_next_start_time(m_exec_hist, run_iter);
+		if (complete_time < hole_end)
+		{
+			m_holes.erase(complete_time);
+		}
+	}
+
+	SUBTASK_ITER next_iter;
+	if (num_before == 0 && num_after == 0)
+	{
+		next_iter = m_exec_hist.erase(run_iter);
+	}
+	else if (num_before == 0)
+	{
+		run_iter->m_start_time = complete_time;
+		run_iter->m_num_subtasks = num_after;
+		next_iter = run_iter;
+	}
+	else if (num_after == 0)
+	{
+		run_iter->m_num_subtasks = num_before;
+		next_iter = std::next(run_iter);
+	}
+	else
+	{
+		run_iter->m_num_subtasks = num_before;
+		next_iter = m_exec_hist.emplace(std::next(run_iter), run_iter->get_job(), *this, complete_time, num_after);
+	}
+	m_holes.insert(hole_start, hole_end, next_iter);
+}
+
+WORKER::SUBTASK_CITER WORKER::insert_run(const JOBS::JOB_ENTRY & job, JOBS::TIME start_time, size_t num_subtasks)
+{
+	const JOBS::TIME complete_time = start_time + num_subtasks * job.get_subtask_duration();
+	const HOLES::HOLE * hole = m_holes.find_earliest_fit(start_time, complete_time - start_time).first;
+	assert(hole != nullptr && hole->start <= start_time && complete_time <= hole->end);
+	const JOBS::TIME hole_start = hole->start;
+	const JOBS::TIME hole_end = hole->end;
+	SUBTASK_ITER next_iter = hole->is_tail() ? m_exec_hist.end() : m_exec_hist.erase(hole->payload, hole->payload);
+	m_holes.erase(hole_start);
+
+	SUBTASK_ITER run_iter = m_exec_hist.emplace(next_iter, job, *this, start_time, num_subtasks);
+	if (hole_start < start_time)
+	{
+		m_holes.insert(hole_start, start_time, run_iter);
+	}
+	if (complete_time < hole_end)
+	{
+		m_holes.insert(complete_time, hole_end, next_iter);
+	}
+	return run_iter;
+}
+
+// Same as removing each of its subtasks, in one go.
+void WORKER::remove_run(SUBTASK_CITER run_iter)
+{
+	const JOBS::TIME start_time = run_iter->get_start_time();
+	const JOBS::TIME complete_time = run_iter->get_complete_time();
+	const JOBS::TIME hole_start = l_get_prev_complete_time(m_exec_hist, run_iter);
+	const JOBS::TIME hole_end = l_get_next_start_time(m_exec_hist, run_iter);
+	if (hole_start < start_time)
+	{
+		m_holes.erase(hole_start);
+	}
+	if (complete_time < hole_end)
+	{
+		m_holes.erase(complete_time);
+	}
+	SUBTASK_ITER next_iter = m_exec_hist.erase(run_iter);
+	m_holes.insert(hole_start, hole_end, next_iter);
 }
 
 void WORKER_MGR::add_worker(WORKER && worker)
 {
-	std::cout << "Hello worker #" << worker.get_index() << " " << worker.get_name() << std::endl;
+	SCHED_LOG(DEBUG) << "Hello worker #" << worker.get_index() << " " << worker.get_name();
+	assert(worker.get_index() == m_workers.size()); // try_submit_job looks workers up by index
 	m_workers.push_back(std::move(worker));
+	m_worker_versions.push_back(0);
+	m_symmetry_class_keys.push_back(NO_SYMMETRY_CLASS);
+	m_hole_worker_positions.push_back(0);
+	add_worker_with_holes(m_workers.back().get_index());
+	update_symmetry_class(m_workers.back().get_index());
 }
 
+void WORKER_MGR::add_worker_with_holes(WORKER::WORKER_IDX worker_idx)
+{
+	m_hole_worker_positions[worker_idx] = m_workers_with_holes.size();
+	m_workers_with_holes.push_back(worker_idx);
+	m_hole_worker_tails.push_back(m_workers[worker_idx].get_tail_start_time());
+	m_hole_worker_last_hole_ends.push_back(m_workers[worker_idx].get_last_hole_end());
+	m_hole_worker_max_hole_lengths.push_back(m_workers[worker_idx].get_max_hole_length());
+}
 
+// The last worker in the list takes its place
+void WORKER_MGR::remove_worker_with_holes(WORKER::WORKER_IDX worker_idx)
+{
+	const size_t position = m_hole_worker_positions[worker_idx];
+	assert(m_workers_with_holes[position] == worker_idx);
+	m_workers_with_holes[position] = m_workers_with_holes.back();
+	m_hole_worker_tails[position] = m_hole_worker_tails.back();
+	m_hole_worker_last_hole_ends[position] = m_hole_worker_last_hole_ends.back();
+	m_hole_worker_max_hole_lengths[position] = m_hole_worker_max_hole_lengths.back();
+	m_hole_worker_positions[m_workers_with_holes[position]] = position;
+	m_workers_with_holes.pop_back();
+	m_hole_worker_tails.pop_back();
+	m_hole_worker_last_hole_ends.pop_back();
+	m_hole_worker_max_hole_lengths.pop_back();
+}
 
-// This is the actual submission algorithm that schedules subtasks across all machines.
-// job_status will be updated to reflect the start & end time for all subtasks, no matter whether
-// revert_after_trying is on or off.
+// Moves the worker to the class matching its timeline. Must be called whenever it changes.
+void WORKER_MGR::update_symmetry_class(WORKER::WORKER_IDX worker_idx)
+{
+	const WORKER & worker = m_workers[worker_idx];
+	const JOBS::TIME old_key = m_symmetry_class_keys[worker_idx];
+	const JOBS::TIME new_key = worker.has_holes() ? NO_SYMMETRY_CLASS : worker.get_tail_start_time();
+	if (new_key == old_key)
+	{
+		if (new_key == NO_SYMMETRY_CLASS)
+		{
+			const size_t position = m_hole_worker_positions[worker_idx];
+			m_hole_worker_tails[position] = worker.get_tail_start_time();
+			m_hole_worker_last_hole_ends[position] = worker.get_last_hole_end();
+			m_hole_worker_max_hole_lengths[position] = worker.get_max_hole_length();
+		}
+		return;
+	}
 
-void WORKER_MGR::try_submit_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, bool revert_after_trying)
+	if (old_key == NO_SYMMETRY_CLASS)
+	{
+		remove_worker_with_holes(worker_idx);
+	}
+	else
+	{
+		auto class_iter = m_symmetry_classes.find(old_key);
+		assert(class_iter != m_symmetry_classes.end());
+		SYMMETRY_CLASS & old_class = class_iter->second;
+		old_class.erase(std::lower_bound(old_class.begin(), old_class.end(), worker_idx));
+		if (old_class.empty())
+		{
+			m_symmetry_classes.erase(class_iter);
+		}
+	}
+
+	if (new_key == NO_SYMMETRY_CLASS)
+	{
+		add_worker_with_holes(worker_idx);
+	}
+	else
+	{
+		SYMMETRY_CLASS & new_class = m_symmetry_classes[new_key];
+		new_class.insert(std::upper_bound(new_class.begin(), new_class.end(), worker_idx), worker_idx);
+	}
+	m_symmetry_class_keys[worker_idx] = new_key;
+}
+
+
+
+JOBS::TIME WORKER_MGR::get_earliest_subtask_start_time(WORKER::WORKER_IDX worker_idx, const JOBS::JOB_ENTRY & job,
+	JOBS::TIME not_before) const
 {
-	bool debug = false;
+	const JOBS::TIME earliest_start = std::max(job.get_earliest_start_time(), not_before);
+	const JOBS::TIME symmetry_class_key = m_symmetry_class_keys[worker_idx];
+	if (symmetry_class_key != NO_SYMMETRY_CLASS)
+	{
+		return std::max(earliest_start, symmetry_class_key); // The tail start time
+	}
+	const size_t position = m_hole_worker_positions[worker_idx];
+	if (m_hole_worker_last_hole_ends[position] < earliest_start + job.get_subtask_duration() ||
+		m_hole_worker_max_hole_lengths[position] < job.get_subtask_duration())
+	{
+		return std::max(earliest_start, m_hole_worker_tails[position]);
+	}
+	return m_workers[worker_idx].get_earliest_subtask_start_time(job, not_before);
+}
 
+// This is the actual submission algorithm that schedules subtasks across all machines. It only
+// reads the workers' history: on_placed(worker_idx, start_time) is called for every subtask, in the
+// order the subtasks should be submitted.
+//
+// Every subtask goes to the worker that completes it the earliest (lowest index on ties). A worker's
+// tentative subtasks always land later than each other: everything before the last one was either
+// too early for the job or too small. So instead of inserting them, it's enough to resume the
+// worker's slot search after its last tentative subtask. That resume point is the overlay, and it
+// only lives in the candidate heap of this call.
+template <typename ON_PLACED>
+void WORKER_MGR::plan_job(const JOBS::JOB_ENTRY & job, ON_PLACED on_placed) const
+{
 	assert(!empty());
-	assert(job_status.is_clean());
-	assert(job_status.get_parent() == job.get_index());
-	job_status.reset();
 
-	// If revert_after_trying == true, this vector is used to memorize submissions, and revert them
-	// in the end. Useful when just want to check out the ETA of a job without submitting anything.
-	std::vector<std::pair<WORKER_ITER, WORKER::SUBTASK_ITER>> submitted_subtasks;
+	const JOBS::TIME duration = job.get_subtask_duration();
+
+	// One per thread, and reused so that projecting doesn't allocate.
+	static thread_local CANDIDATE_HEAP candidates;
+	const std::greater<CANDIDATE> later;
+	candidates.clear();
+	for (const auto & key_class_pair: m_symmetry_classes)
+	{
+		const SYMMETRY_CLASS & symmetry_class = key_class_pair.second;
+		const WORKER & worker = m_workers[symmetry_class.front()];
+		candidates.push_back(CANDIDATE{
+			worker.get_earliest_subtask_start_time(job, 0) + duration, worker.get_index(), &symmetry_class, 1});
+	}
+
+	// Most workers with holes have none late enough for the job, and offer the slot after their last
+	// subtask. One pass finds those, and only the others get a slot search.
+	static thread_local std::vector<JOBS::TIME> tail_complete_times;
+	tail_complete_times.resize(m_workers_with_holes.size());
+	const WORKER_TIMES worker_times{m_workers_with_holes.size(), m_hole_worker_tails.data(),
+		m_hole_worker_last_hole_ends.data(), m_hole_worker_max_hole_lengths.data()};
+	l_get_project_tails()(worker_times, 0, job.get_earliest_start_time(), duration, tail_complete_times.data());
+	for (size_t i = 0; i < m_workers_with_holes.size(); ++i)
+	{
+		const WORKER::WORKER_IDX worker_idx = m_workers_with_holes[i];
+		JOBS::TIME complete_time = tail_complete_times[i];
+		if (complete_time == 0)
+		{
+			complete_time = m_workers[worker_idx].get_earliest_subtask_start_time(job, 0) + duration;
+		}
+		candidates.push_back(CANDIDATE{complete_time, worker_idx, nullptr, 0});
+	}
+	std::make_heap(candidates.begin(), candidates.end(), later);
+	if (SCHED_STATS_ENABLED && STATS::STATS_MGR::is_enabled())
+	{
+		// Every worker was evaluated for the first subtask, and then one more worker for each.
+		STATS::STATS_MGR::record(STATS::HISTOGRAM::WORKERS_EVALUATED_PER_SUBTASK, candidates.size() + 1);
+		if (job.get_num_subtasks() > 1)
+		{
+			STATS::STATS_MGR::record(STATS::HISTOGRAM::WORKERS_EVALUATED_PER_SUBTASK, 1, job.get_num_subtasks() - 1);
+		}
+	}
 
 	for (size_t i_subtask = 0; i_subtask < job.get_num_subtasks(); ++i_subtask)
 	{
 		// Pick worker with best completion time
-		WORKER_ITER best_worker_iter = std::min_element(
-			m_workers.begin(), m_workers.end(),
-			[&job](const WORKER & lhs, const WORKER & rhs)
-			{
-				return bool(
-					lhs.try_submit_subtask(job).get_complete_time() <
-					rhs.try_submit_subtask(job).get_complete_time());
-			}
-		);
+		std::pop_heap(candidates.begin(), candidates.end(), later);
+		const CANDIDATE best = candidates.back();
 
-		// Submit it
-		WORKER::SUBTASK_ITER subtask_iter = best_worker_iter->submit_subtask(job);
-		job_status.add_subtask(*subtask_iter);
+		on_placed(best.worker_idx, best.complete_time - duration);
 
-		if (revert_after_trying)
+		// From here on, the worker's timeline is its own
+		candidates.back() = CANDIDATE{
+			get_earliest_subtask_start_time(best.worker_idx, job, best.complete_time) + duration, best.worker_idx, nullptr, 0};
+		std::push_heap(candidates.begin(), candidates.end(), later);
+
+		if (best.peers != nullptr && best.next_peer < best.peers->size())
 		{
-			submitted_subtasks.push_back(std::make_pair(best_worker_iter, subtask_iter));
+			candidates.push_back(CANDIDATE{
+				best.complete_time, (*best.peers)[best.next_peer], best.peers, best.next_peer + 1});
+			std::push_heap(candidates.begin(), candidates.end(), later);
 		}
 	}
 
-	if (revert_after_trying)
+	// TODO: Compress start time when possible. QoR measurement
+}
+
+// If placements isn't null, where every subtask went is appended to it.
+void WORKER_MGR::submit_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, PLACEMENTS * placements)
+{
+	assert(job_status.is_clean());
+	assert(job_status.get_parent() == job.get_index());
+	job_status.reset();
+
+	// Submitting in planned order makes each worker find exactly the planned slot. Symmetry classes
+	// are only updated after planning, which walks through them.
+	m_workers_touched.clear();
+	plan_job(job,
+		[this, &job, &job_status, placements](WORKER::WORKER_IDX worker_idx, JOBS::TIME start_time)
+		{
+			WORKER::SUBTASK_CITER run_iter;
+			JOBS::TIME submitted_start_time = m_workers[worker_idx].submit_subtask(job, &run_iter);
+			++m_worker_versions[worker_idx];
+			m_workers_touched.push_back(worker_idx);
+			assert(submitted_start_time == start_time);
+			(void) submitted_start_time;
+			job_status.add_subtask(start_time, start_time + job.get_subtask_duration());
+			if (placements != nullptr)
+			{
+				placements->push_back(PLACEMENT{worker_idx, start_time, run_iter});
+			}
+		});
+
+	for (WORKER::WORKER_IDX worker_idx: m_workers_touched)
+	{
+		update_symmetry_class(worker_idx);
+	}
+
+	SCHED_LOG(TRACE) << job.to_string() << "\n" << job_status.to_string();
+	assert(job_status.submitted());
+	JOBS::COST_CALC::COST_ENGINE::get_inst().commit_job(job);
+
+	if (job.get_index() < m_projection_cache.size())
+	{
+		// Won't be projected anymore
+		m_projection_cache[job.get_index()] = PROJECTION_CACHE_ENTRY();
+	}
+}
+
+// Every subtask goes to the worker whose tail completes it the earliest (lowest index on ties). A
+// worker's subtasks are back to back from where it first offered, so how many it got can be told
+// from its last candidate, and it takes them as one run.
+void WORKER_MGR::append_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status)
+{
+	assert(!empty());
+	assert(job_status.is_clean());
+	assert(job_status.get_parent() == job.get_index());
+	job_status.reset();
+
+	const JOBS::TIME duration = job.get_subtask_duration();
+	static thread_local CANDIDATE_HEAP candidates;
+	const std::greater<CANDIDATE> later;
+	candidates.clear();
+	for (const WORKER & worker: m_workers)
+	{
+		candidates.push_back(CANDIDATE{
+			std::max(worker.get_tail_start_time(), job.get_earliest_start_time()) + duration, worker.get_index(), nullptr, 0});
+	}
+	std::make_heap(candidates.begin(), candidates.end(), later);
+	for (size_t i_subtask = 0; i_subtask < job.get_num_subtasks(); ++i_subtask)
+	{
+		std::pop_heap(candidates.begin(), candidates.end(), later);
+		candidates.back().complete_time += duration;
+		std::push_heap(candidates.begin(), candidates.end(), later);
+	}
+
+	for (const CANDIDATE & candidate: candidates)
 	{
-		for (const auto & worker_subtask_iter_pair: submitted_subtasks)
+		const WORKER::WORKER_IDX worker_idx = candidate.worker_idx;
+		const JOBS::TIME start_time = std::max(m_workers[worker_idx].get_tail_start_time(), job.get_earliest_start_time());
+		const size_t num_subtasks = (candidate.complete_time - start_time) / duration - 1;
+		if (num_subtasks == 0)
+		{
+			continue;
+		}
+		m_workers[worker_idx].insert_run(job, start_time, num_subtasks);
+		++m_worker_versions[worker_idx];
+		update_symmetry_class(worker_idx);
+		for (size_t i = 0; i < num_subtasks; ++i)
 		{
-			worker_subtask_iter_pair.first->remove_subtask(worker_subtask_iter_pair.second);
+			job_status.add_subtask(start_time + i * duration, start_time + (i + 1) * duration);
 		}
 	}
-	if (debug)
+
+	SCHED_LOG(TRACE) << job.to_string() << "\n" << job_status.to_string();
+	assert(job_status.submitted());
+	JOBS::COST_CALC::COST_ENGINE::get_inst().commit_job(job);
+
+	if (job.get_index() < m_projection_cache.size())
 	{
-		std::cout << job.to_string() << std::endl;
-		std::cout << job_status.to_string() << std::endl;
+		m_projection_cache[job.get_index()] = PROJECTION_CACHE_ENTRY();
 	}
-	assert(job_status.submitted());
+}
 
-	// TODO: Compress start time when possible. QoR measurement
+void WORKER_MGR::sort_by_run(const PLACEMENTS & placements)
+{
+	m_placements_by_run.assign(placements.cbegin(), placements.cend());
+	std::sort(m_placements_by_run.begin(), m_placements_by_run.end(),
+		[](const PLACEMENT & lhs, const PLACEMENT & rhs)
+		{
+			return (lhs.worker_idx != rhs.worker_idx) ? lhs.worker_idx < rhs.worker_idx : lhs.start_time < rhs.start_time;
+		});
 }
 
-void WORKER_MGR::submit_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status)
+void WORKER_MGR::remove_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, const PLACEMENTS & placements)
 {
-	try_submit_job(job, job_status, false);
+	assert(job_status.submitted());
+	assert(placements.size() == job.get_num_subtasks());
+
+	// A run's subtasks come one after the other once sorted
+	sort_by_run(placements);
+	for (size_t i = 0; i < m_placements_by_run.size(); ++i)
+	{
+		const PLACEMENT & placement = m_placements_by_run[i];
+		if (i > 0 && m_placements_by_run[i - 1].run == placement.run)
+		{
+			continue;
+		}
+		m_workers[placement.worker_idx].remove_run(placement.run);
+		++m_worker_versions[placement.worker_idx];
+		update_symmetry_class(placement.worker_idx);
+	}
+	++m_removal_version;
+	JOBS::COST_CALC::COST_ENGINE::get_inst().revert_job(job);
+	job_status.reset();
 }
 
+void WORKER_MGR::restore_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, PLACEMENTS & placements)
+{
+	assert(job_status.is_clean());
+	assert(placements.size() == job.get_num_subtasks());
+	const JOBS::TIME duration = job.get_subtask_duration();
+
+	// Back to back subtasks on a worker go back as one run
+	sort_by_run(placements);
+	placements.clear();
+	size_t run_begin = 0;
+	while (run_begin < m_placements_by_run.size())
+	{
+		const WORKER::WORKER_IDX worker_idx = m_placements_by_run[run_begin].worker_idx;
+		const JOBS::TIME start_time = m_placements_by_run[run_begin].start_time;
+		size_t run_end = run_begin + 1;
+		while (run_end < m_placements_by_run.size() &&
+			m_placements_by_run[run_end].worker_idx == worker_idx &&
+			m_placements_by_run[run_end].start_time == start_time + (run_end - run_begin) * duration)
+		{
+			++run_end;
+		}
+		WORKER::SUBTASK_CITER run_iter = m_workers[worker_idx].insert_run(job, start_time, run_end - run_begin);
+		++m_worker_versions[worker_idx];
+		update_symmetry_class(worker_idx);
+		for (size_t i = run_begin; i < run_end; ++i)
+		{
+			JOBS::TIME subtask_start_time = m_placements_by_run[i].start_time;
+			job_status.add_subtask(subtask_start_time, subtask_start_time + duration);
+			placements.push_back(PLACEMENT{worker_idx, subtask_start_time, run_iter});
+		}
+		run_begin = run_end;
+	}
+	assert(job_status.submitted());
+	JOBS::COST_CALC::COST_ENGINE::get_inst().commit_job(job);
+}
 
-JOBS::JOB_STATUS WORKER_MGR::get_projected_job_status(const JOBS::JOB_ENTRY & job)
+// Where the job would end up if it were submitted now. The workers are left untouched, so this is
+// safe to call from several threads at once.
+JOBS::JOB_STATUS WORKER_MGR::get_projected_job_status(const JOBS::JOB_ENTRY & job) const
 {
+	STATS::SCOPE_TIMER timer(STATS::HISTOGRAM::PROJECTION_NS);
 	JOBS::JOB_STATUS projected_status;
 	projected_status.set_parent(job.get_index());
-	try_submit_job(job, projected_status, true);
+	projected_status.reset();
+
+	const JOBS::TIME duration = job.get_subtask_duration();
+	plan_job(job,
+		[&projected_status, duration](WORKER::WORKER_IDX, JOBS::TIME start_time)
+		{
+			projected_status.add_subtask(start_time, start_time + duration);
+		});
+
+	assert(projected_status.submitted());
 	return projected_status;
 }
 
+const JOBS::JOB_STATUS & WORKER_MGR::get_cached_projected_job_status(const JOBS::JOB_ENTRY & job)
+{
+	assert(job.get_index() < m_projection_cache.size());
+	PROJECTION_CACHE_ENTRY & entry = m_projection_cache[job.get_index()];
+
+	if (entry.valid && entry.removal_version == m_removal_version &&
+		std::all_of(entry.depends_on.cbegin(), entry.depends_on.cend(),
+			[this](const std::pair<WORKER::WORKER_IDX, VERSION> & worker_version_pair)
+			{
+				return m_worker_versions[worker_version_pair.first] == worker_version_pair.second;
+			}))
+	{
+		SCHED_STAT_ADD(PROJECTION_CACHE_HITS, 1);
+		SCHED_TRACE(PROJECTION, job.get_index(), entry.status.get_complete_time(), 1);
+		return entry.status;
+	}
+	SCHED_STAT_ADD(PROJECTION_CACHE_MISSES, 1);
+	STATS::SCOPE_TIMER timer(STATS::HISTOGRAM::PROJECTION_NS);
+
+	entry.status = JOBS::JOB_STATUS();
+	entry.status.set_parent(job.get_index());
+	entry.status.reset();
+	entry.depends_on.clear();
+	entry.removal_version = m_removal_version;
+
+	const JOBS::TIME duration = job.get_subtask_duration();
+	plan_job(job,
+		[this, &entry, duration](WORKER::WORKER_IDX worker_idx, JOBS::TIME start_time)
+		{
+			entry.status.add_subtask(start_time, start_time + duration);
+			entry.depends_on.push_back(std::make_pair(worker_idx, m_worker_versions[worker_idx]));
+		});
+	assert(entry.status.submitted());
+
+	// A worker shows up once per subtask it got
+	std::sort(entry.depends_on.begin(), entry.depends_on.end());
+	entry.depends_on.erase(std::unique(entry.depends_on.begin(), entry.depends_on.end()), entry.depends_on.end());
+	entry.valid = true;
+	SCHED_TRACE(PROJECTION, job.get_index(), entry.status.get_complete_time(), 0);
+	return entry.status;
+}
+
+void WORKER_MGR::resize_projection_cache(size_t num_jobs)
+{
+	m_projection_cache.resize(num_jobs);
+}
+
 WORKER_MGR::WORKER_ITER WORKER_MGR::begin()
 {
 	return m_workers.begin();
@@ -265,17 +857,16 @@ WORKER_MGR::WORKER_CITER WORKER_MGR::cend() const
 
 bool WORKER_MGR::execution_history_is_legal() const
 {
-	std::cout << "Checking worker execution history legality...\n";
+	SCHED_LOG(INFO) << "Checking worker execution history legality...";
 	for (const WORKER & worker: m_workers)
 	{
 		if (worker.execution_history_is_legal() == false)
 		{
-			std::cout << "Found illegal worker: " << worker.get_name() << std::endl;
-			std::cout << worker;
+			SCHED_LOG(ERROR) << "Found illegal worker: " << worker.get_name() << "\n" << worker;
 			return false;
 		}
 	}
-	std::cout << "All legal!\n";
+	SCHED_LOG(INFO) << "All legal!";
 	return true;
 }
 
@@ -291,11 +882,7 @@ bool WORKER_MGR::empty() const
 
 WORKER_MGR & WORKER_MGR::get_inst()
 {
-	if (m_inst == nullptr)
-	{
-		m_inst = new WORKER_MGR;
-	}
-	return *m_inst;
+	return CONTEXT::SCHED_CONTEXT::get_current().get_worker_mgr();
 }
 
 std::ostream & operator<<(std::ostream & os, const WORKER_MGR & worker_mgr)
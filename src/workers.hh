@@ -3,9 +3,18 @@
 #define WORKERS_HH
 
 #include "jobs.hh"
+#include "hole_index.hh"
+#include "node_pool.hh"
 
 #include <string>
 #include <vector>
+#include <list>
+#include <map>
+
+namespace CONTEXT
+{
+class SCHED_CONTEXT;
+}
 
 namespace WORKERS
 {
@@ -14,40 +23,47 @@ typedef std::string WORKER_NAME;
 
 class WORKER;
 
-class SUBTASK
+// Subtasks of one job that run back to back on a worker, from the start time on. Subtask i of the
+// run spans [start + i * duration, start + (i + 1) * duration).
+class SUBTASK_RUN
 {
 public:
-	SUBTASK() = delete;
-	SUBTASK(const SUBTASK &) = default;
-	SUBTASK(SUBTASK &&) = default;
-	SUBTASK & operator=(const SUBTASK &) = delete;
-	SUBTASK & operator=(SUBTASK &&) = delete;
-	~SUBTASK() = default;
+	SUBTASK_RUN() = delete;
+	SUBTASK_RUN(const SUBTASK_RUN &) = default;
+	SUBTASK_RUN(SUBTASK_RUN &&) = default;
+	SUBTASK_RUN & operator=(const SUBTASK_RUN &) = delete;
+	SUBTASK_RUN & operator=(SUBTASK_RUN &&) = delete;
+	~SUBTASK_RUN() = default;
 
-	SUBTASK(const JOBS::JOB_ENTRY & job, const WORKER & worker, JOBS::TIME start_time);
+	SUBTASK_RUN(const JOBS::JOB_ENTRY & job, const WORKER & worker, JOBS::TIME start_time, size_t num_subtasks = 1);
 
 	JOBS::TIME get_start_time() const;
 	JOBS::TIME get_complete_time() const; // Defined to be overlapped with next job start time
-	const JOBS::JOB_ENTRY & get_job() const;
+	JOBS::TIME get_subtask_start_time(size_t subtask_in_run) const;
+	size_t get_num_subtasks() const { return m_num_subtasks; }
+	JOBS::JOB_IDX get_job_index() const { return m_job_idx; }
+	JOBS::JOB_ENTRY get_job() const;
 
-	std::string to_string() const;
+	std::string to_string(size_t subtask_in_run) const; // One subtask
 
 private:
-	// TODO: dangerous using refs. Should use indices.
-	const JOBS::JOB_ENTRY & m_job;
-	const WORKER & m_worker;
-	JOBS::TIME m_start_time;
+	friend class WORKER; // Grows, shrinks and splits runs
 
+	JOBS::TIME m_start_time;
+	JOBS::JOB_IDX m_job_idx;
+	uint32_t m_worker_idx;
+	uint32_t m_num_subtasks;
 };
 
 
 class WORKER
 {
 public:
-	typedef std::list<SUBTASK> SUBTASK_CONTAINER;
+	typedef std::list<SUBTASK_RUN, NODE_ALLOCATOR<SUBTASK_RUN>> SUBTASK_CONTAINER; // Runs aren't always maximal
 	typedef WORKER::SUBTASK_CONTAINER::iterator SUBTASK_ITER;
 	typedef WORKER::SUBTASK_CONTAINER::const_iterator SUBTASK_CITER;
-	typedef size_t WORKER_IDX;
+	typedef HOLE_INDEX<SUBTASK_CITER> HOLES; // Payload is the run right after the hole
+	typedef uint32_t WORKER_IDX;
 
 	// Implicit xtors
 	WORKER() = delete;
@@ -58,7 +74,9 @@ public:
 	~WORKER() = default;
 
 	// Custom ctors
-	WORKER(WORKER_NAME && name, WORKER_IDX idx);
+	// History nodes come from the pool (see WORKER_MGR::get_history_node_pool), which must outlive the
+	// worker.
+	WORKER(WORKER_NAME && name, WORKER_IDX idx, NODE_POOL & history_node_pool);
 
 	// Getters
 	const WORKER_NAME & get_name() const;
@@ -66,12 +84,22 @@ public:
 	SUBTASK_CITER cbegin() const;
 	SUBTASK_CITER cend() const;
 	const SUBTASK_CONTAINER & get_history() const;
+	const HOLES & get_holes() const;
+	bool has_holes() const { return m_holes.size() > 1; } // Other than the trailing idle time
+	JOBS::TIME get_tail_start_time() const;
+	JOBS::TIME get_last_hole_end() const; // Of the last hole before the trailing idle time, 0 if none
+	JOBS::TIME get_max_hole_length() const; // Same
 	bool execution_history_is_legal() const;
-	SUBTASK try_submit_subtask(const JOBS::JOB_ENTRY & job) const;
+	SUBTASK_RUN try_submit_subtask(const JOBS::JOB_ENTRY & job) const;
+	JOBS::TIME get_earliest_subtask_start_time(const JOBS::JOB_ENTRY & job, JOBS::TIME not_before) const;
 
 	// Modifiers
-	SUBTASK_ITER submit_subtask(const JOBS::JOB_ENTRY & job);
-	void remove_subtask(SUBTASK_ITER subtask_iter);
+	// Returns the start time. If run_iter isn't null, it's set to the run the subtask went into.
+	JOBS::TIME submit_subtask(const JOBS::JOB_ENTRY & job, SUBTASK_CITER * run_iter = nullptr);
+	void remove_subtask(SUBTASK_ITER run_iter, size_t subtask_in_run);
+	// Puts a run back at a time the worker is idle, without merging it with its neighbors.
+	SUBTASK_CITER insert_run(const JOBS::JOB_ENTRY & job, JOBS::TIME start_time, size_t num_subtasks);
+	void remove_run(SUBTASK_CITER run_iter);
 
 	// Friends
 	friend std::ostream & operator<<(std::ostream & os, const WORKER & worker);
@@ -80,6 +108,7 @@ private:
 	WORKER_NAME m_name;
 	WORKER_IDX m_idx = 0;
 	SUBTASK_CONTAINER m_exec_hist;
+	HOLES m_holes; // Always in sync with m_exec_hist
 };
 
 std::ostream & operator<<(std::ostream & os, const WORKER & worker);
@@ -92,13 +121,40 @@ private:
 public:
 	typedef WORKER_CONTAINER::iterator WORKER_ITER;
 	typedef WORKER_CONTAINER::const_iterator WORKER_CITER;
+	typedef size_t VERSION;
+
+	// Where one subtask of a job went
+	struct PLACEMENT
+	{
+		WORKER::WORKER_IDX worker_idx;
+		JOBS::TIME start_time;
+		WORKER::SUBTASK_CITER run; // Holding the subtask, until the job is taken out
+	};
+	typedef std::vector<PLACEMENT> PLACEMENTS;
 
 	WORKER_MGR & operator=(const WORKER_MGR &) = delete;
 	WORKER_MGR & operator=(WORKER_MGR &&) = delete;
 
 	void add_worker(WORKER && worker);
-	void submit_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status);
-	JOBS::JOB_STATUS get_projected_job_status(const JOBS::JOB_ENTRY & job);
+	void submit_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, PLACEMENTS * placements = nullptr);
+	// Same, but every subtask goes after the last subtask of a worker, without looking for holes.
+	// Much cheaper, for when there's no time for a proper placement.
+	void append_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status);
+	// Takes a submitted job out of the workers, given where all of its subtasks went, and resets its
+	// status. Later jobs stay where they are.
+	void remove_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, const PLACEMENTS & placements);
+	// Puts a job's subtasks back exactly where they were, which must still be free. Updates their runs.
+	void restore_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, PLACEMENTS & placements);
+	JOBS::JOB_STATUS get_projected_job_status(const JOBS::JOB_ENTRY & job) const;
+
+	// Same as get_projected_job_status, but reuses the last projection of the job when none of the
+	// workers it landed on changed since. Safe to call from several threads for different jobs.
+	const JOBS::JOB_STATUS & get_cached_projected_job_status(const JOBS::JOB_ENTRY & job);
+	void resize_projection_cache(size_t num_jobs); // Hits and misses are counted in STATS
+
+	// Shared by the execution history of every worker
+	NODE_POOL & get_history_node_pool() { return m_history_node_pool; }
+	const NODE_POOL & get_history_node_pool() const { return m_history_node_pool; }
 
 	WORKER_ITER begin();
 	WORKER_ITER end();
@@ -117,16 +173,60 @@ public:
 	static WORKER_MGR & get_inst();
 
 private:
+	// Last projection of one job, and the version of every worker it put a subtask on.
+	//
+	// Submitting work to a worker can only push its free slots later. So if the workers a projection
+	// used didn't change, the others are at best as good as before: the projection still holds.
+	struct PROJECTION_CACHE_ENTRY
+	{
+		bool valid = false;
+		JOBS::JOB_STATUS status;
+		std::vector<std::pair<WORKER::WORKER_IDX, VERSION>> depends_on;
+		VERSION removal_version = 0;
+	};
+
+	// Workers without holes and with the same tail start time answer every slot search the same way,
+	// so plan_job() only asks one of them. Members are sorted by index.
+	typedef std::vector<WORKER::WORKER_IDX> SYMMETRY_CLASS;
+	static constexpr JOBS::TIME NO_SYMMETRY_CLASS = WORKER::HOLES::INF_TIME;
+
+	friend class CONTEXT::SCHED_CONTEXT;
+
 	WORKER_MGR() = default;
 	WORKER_MGR(const WORKER_MGR &) = delete;
 	WORKER_MGR(WORKER_MGR &&) = delete;
 	~WORKER_MGR() = default;
 
-	void try_submit_job(const JOBS::JOB_ENTRY & job, JOBS::JOB_STATUS & job_status, bool revert_after_trying);
-
+	template <typename ON_PLACED>
+	void plan_job(const JOBS::JOB_ENTRY & job, ON_PLACED on_placed) const;
+	// Same as the worker's own, without a slot search when only its trailing idle time can do
+	JOBS::TIME get_earliest_subtask_start_time(WORKER::WORKER_IDX worker_idx, const JOBS::JOB_ENTRY & job,
+		JOBS::TIME not_before) const;
+	void update_symmetry_class(WORKER::WORKER_IDX worker_idx);
+	void add_worker_with_holes(WORKER::WORKER_IDX worker_idx);
+	void remove_worker_with_holes(WORKER::WORKER_IDX worker_idx);
+	void sort_by_run(const PLACEMENTS & placements); // Into m_placements_by_run
+
+	NODE_POOL m_history_node_pool; // Before m_workers, which give their nodes back when destroyed
 	WORKER_CONTAINER m_workers;
 
-	static WORKER_MGR * m_inst;
+	// Bumped whenever WORKER_MGR submits to the worker. Taking subtasks out can make any projection
+	// better, not only the ones that used the worker, so that bumps m_removal_version instead.
+	std::vector<VERSION> m_worker_versions;
+	VERSION m_removal_version = 0;
+
+	std::map<JOBS::TIME, SYMMETRY_CLASS> m_symmetry_classes; // By tail start time
+	std::vector<WORKER::WORKER_IDX> m_workers_with_holes; // Every worker not in a class, in no order
+	// Tail start time, last hole end and longest hole of each worker in m_workers_with_holes, in the
+	// same order, so that plan_job() can go through them in one vectorized pass
+	std::vector<JOBS::TIME> m_hole_worker_tails;
+	std::vector<JOBS::TIME> m_hole_worker_last_hole_ends;
+	std::vector<JOBS::TIME> m_hole_worker_max_hole_lengths;
+	std::vector<size_t> m_hole_worker_positions; // In m_workers_with_holes, indexed by worker
+	std::vector<JOBS::TIME> m_symmetry_class_keys; // Indexed by worker, NO_SYMMETRY_CLASS if none
+	std::vector<WORKER::WORKER_IDX> m_workers_touched; // By the job being submitted
+	PLACEMENTS m_placements_by_run; // Scratch for remove_job() and restore_job()
+	std::vector<PROJECTION_CACHE_ENTRY> m_projection_cache; // Indexed by job index
 };
 std::ostream & operator<<(std::ostream & os, const WORKER_MGR & worker_mgr);
 